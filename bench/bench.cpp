@@ -0,0 +1,1166 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#include "engine/common/number_generator.hpp"
+#include "engine/common/color_utils.hpp"
+#include "physics/physics.hpp"
+#include "thread_pool/thread_pool.hpp"
+#include "renderer/software_renderer.hpp"
+#include "renderer/render_frame.hpp"
+
+
+struct BenchOptions
+{
+    std::string command    = "integrator";
+    uint32_t    count      = 300000;
+    uint32_t    iterations = 200;
+    uint32_t    threads    = 10;
+    // Frame budget of the capacity search
+    uint32_t    fps        = 60;
+};
+
+using BenchClock = std::chrono::steady_clock;
+
+double getElapsedMs(BenchClock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+// Integration loop as it was before the fused kernels, used as reference
+void integrateLegacy(PhysicObject* objects, uint32_t count, const integrator::Parameters& params)
+{
+    for (uint32_t i{0}; i < count; ++i) {
+        PhysicObject& obj = objects[i];
+        obj.acceleration += params.gravity;
+        obj.update(params.dt);
+        if (obj.position.x > params.max_position.x) {
+            obj.position.x = params.max_position.x;
+        } else if (obj.position.x < params.min_position.x) {
+            obj.position.x = params.min_position.x;
+        }
+        if (obj.position.y > params.max_position.y) {
+            obj.position.y = params.max_position.y;
+        } else if (obj.position.y < params.min_position.y) {
+            obj.position.y = params.min_position.y;
+        }
+    }
+}
+
+std::vector<PhysicObject> createRandomObjects(uint32_t count, Vec2 world_size)
+{
+    std::vector<PhysicObject> objects(count);
+    for (PhysicObject& obj : objects) {
+        obj.setPosition({RNGf::getUnder(world_size.x), RNGf::getUnder(world_size.y)});
+        obj.addVelocity({RNGf::getRange(0.1f), RNGf::getRange(0.1f)});
+    }
+    return objects;
+}
+
+void benchIntegrator(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const Vec2 world_size{600.0f, 600.0f};
+    const std::vector<PhysicObject> initial = createRandomObjects(options.count, world_size);
+    const float margin = 2.0f;
+    const integrator::Parameters params{{0.0f, 20.0f}, 1.0f / 480.0f, PhysicObject::velocity_damping,
+                                        {margin, margin}, {world_size.x - margin, world_size.y - margin}};
+
+    const auto run = [&](integrator::Kernel kernel, std::vector<PhysicObject>& objects) {
+        const auto start = BenchClock::now();
+        for (uint32_t i{options.iterations}; i--;) {
+            thread_pool.dispatch(options.count, [&](uint32_t begin, uint32_t end) {
+                kernel(objects.data() + begin, end - begin, params);
+            });
+        }
+        return getElapsedMs(start) / options.iterations;
+    };
+
+    std::vector<PhysicObject> reference = initial;
+    const double reference_ms = run(integrateLegacy, reference);
+
+    const double bytes = 2.0 * sizeof(PhysicObject) * options.count;
+    const auto report = [&](const std::string& name, double ms, float max_error) {
+        std::cout << std::left << std::setw(8) << name << std::right
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(10) << ms << " ms"
+                  << std::setw(10) << (ms * 1.0e6 / options.count) << " ns/obj"
+                  << std::setw(10) << (bytes / (ms * 1.0e6)) << " GB/s"
+                  << std::setw(8)  << std::setprecision(2) << (reference_ms / ms) << "x"
+                  << "   max error " << std::scientific << max_error << std::defaultfloat << std::endl;
+    };
+
+    std::cout << options.count << " objects, " << options.iterations << " iterations, " << options.threads << " threads" << std::endl;
+    report("legacy", reference_ms, 0.0f);
+    for (const integrator::Kind kind : {integrator::Kind::Scalar, integrator::Kind::SSE, integrator::Kind::AVX}) {
+        if (!integrator::isSupported(kind)) {
+            std::cout << integrator::getName(kind) << " not supported" << std::endl;
+            continue;
+        }
+        std::vector<PhysicObject> objects = initial;
+        const double ms = run(integrator::getKernel(kind), objects);
+        float max_error = 0.0f;
+        for (uint32_t i{0}; i < options.count; ++i) {
+            max_error = std::max(max_error, MathVec2::length(objects[i].position - reference[i].position));
+        }
+        report(integrator::getName(kind), ms, max_error);
+    }
+}
+
+void benchSpawn(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{600, 600};
+    const auto position = [&](uint32_t i) {
+        return Vec2{2.0f + to<float>(i % 596), 2.0f + to<float>((i / 596) % 596)};
+    };
+
+    std::cout << options.count << " objects, " << options.threads << " threads" << std::endl;
+    {
+        PhysicSolver solver{world_size, thread_pool};
+        const auto start = BenchClock::now();
+        for (uint32_t i{0}; i < options.count; ++i) {
+            solver.createObject(position(i), to<ColorIndex>(i % Palette::default_size));
+        }
+        std::cout << "createObject  " << getElapsedMs(start) << " ms" << std::endl;
+    }
+    {
+        PhysicSolver solver{world_size, thread_pool};
+        const auto start = BenchClock::now();
+        solver.createObjects(options.count, [&](uint32_t i, civ::ID, PhysicObject& obj, ColorIndex& color) {
+            obj.setPosition(position(i));
+            color = to<ColorIndex>(i % Palette::default_size);
+        });
+        std::cout << "createObjects " << getElapsedMs(start) << " ms" << std::endl;
+    }
+}
+
+// Removes and creates back a tenth of the objects at each iteration, both sides create the objects the same way
+void benchChurn(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{600, 600};
+    const uint32_t churn_count = options.count / 10;
+    const auto initializer = [](uint32_t i, civ::ID, PhysicObject& obj) {
+        obj.setPosition({2.0f + to<float>(i % 596), 2.0f + to<float>((i / 596) % 596)});
+    };
+
+    std::cout << options.count << " objects, " << churn_count << " removed and created per iteration, "
+              << options.threads << " threads" << std::endl;
+    {
+        PhysicSolver solver{world_size, thread_pool};
+        solver.createObjects(options.count, initializer);
+        const auto start = BenchClock::now();
+        for (uint32_t i{options.iterations}; i--;) {
+            for (uint32_t k{churn_count}; k--;) {
+                solver.eraseObject(solver.objects.getID(RNGu64::getUnder(solver.objects.size() - 1)));
+            }
+            solver.createObjects(options.count - to<uint32_t>(solver.objects.size()), initializer);
+        }
+        std::cout << "eraseObject   " << getElapsedMs(start) / options.iterations << " ms" << std::endl;
+    }
+    {
+        PhysicSolver solver{world_size, thread_pool};
+        solver.createObjects(options.count, initializer);
+        const auto start = BenchClock::now();
+        for (uint32_t i{options.iterations}; i--;) {
+            for (uint32_t k{churn_count}; k--;) {
+                solver.removeObjectAt(RNGu64::getUnder(solver.objects.size() - 1));
+            }
+            solver.flushRemovals();
+            solver.createObjects(options.count - to<uint32_t>(solver.objects.size()), initializer);
+        }
+        std::cout << "flushRemovals " << getElapsedMs(start) / options.iterations << " ms" << std::endl;
+    }
+    {
+        // An object marked then erased before the flush must not remove the object created in its slot
+        PhysicSolver solver{world_size, thread_pool};
+        solver.createObjects(4, initializer);
+        const civ::ID erased_id = solver.objects.getID(1);
+        solver.removeObject(erased_id);
+        solver.eraseObject(erased_id);
+        const civ::ID created_id = solver.createObject({300.0f, 300.0f});
+        solver.flushRemovals();
+        const bool valid = solver.objects.size() == 4 && solver.objects.getDataID(created_id) < solver.objects.size();
+        std::cout << "mark, erase, create then flush: " << solver.objects.size() << " objects left"
+                  << (valid ? "" : " (ERROR)") << std::endl;
+    }
+}
+
+void benchRaster(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{600, 600};
+    PhysicSolver solver{world_size, thread_pool};
+    // Objects spread over the whole world, one step fills the collision grid
+    const uint32_t columns = 596;
+    solver.createObjects(options.count, [&](uint32_t i, civ::ID, PhysicObject& obj, ColorIndex& color) {
+        const float y = 2.0f + to<float>(i / columns) * 596.0f / std::ceil(to<float>(options.count) / columns);
+        obj.setPosition({2.0f + to<float>(i % columns), y});
+        color = to<ColorIndex>(i % Palette::default_size);
+    });
+    solver.update(1.0f / 60.0f);
+
+    SoftwareRenderer renderer{solver, thread_pool, 1920, 1080};
+    std::cout << options.count << " objects, 1920x1080, " << options.threads << " threads" << std::endl;
+    const auto start = BenchClock::now();
+    for (uint32_t i{options.iterations}; i--;) {
+        renderer.render();
+    }
+    const double frame_ms = getElapsedMs(start) / options.iterations;
+    std::cout << "software " << frame_ms << " ms (" << 1000.0 / frame_ms << " fps)" << std::endl;
+}
+
+// Runs the same scene with float and fixed point positions
+void benchQuantized(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    // Square block of objects falling on the floor of a world twice as wide
+    const auto block_size = to<uint32_t>(std::ceil(std::sqrt(to<float>(options.count))));
+    const auto world_side = to<int32_t>(std::min(2.0f * to<float>(block_size) + 8.0f, fixed::max_world));
+    const IVec2 world_size{world_side, world_side};
+    const auto initializer = [&](uint32_t i, civ::ID, auto& obj) {
+        const float offset = 0.5f * to<float>(world_side - to<int32_t>(block_size));
+        obj.setPosition({offset + to<float>(i % block_size), 4.0f + to<float>(i / block_size)});
+    };
+    PhysicSolver          float_solver{world_size, thread_pool};
+    QuantizedPhysicSolver fixed_solver{world_size, thread_pool};
+    float_solver.createObjects(options.count, initializer);
+    fixed_solver.createObjects(options.count, initializer);
+
+    const auto compare = [&](const char* label) {
+        double error_sum = 0.0;
+        float  max_error = 0.0f;
+        double height_sum[2] = {0.0, 0.0};
+        for (uint32_t i{0}; i < options.count; ++i) {
+            const Vec2 float_position = float_solver.objects.data[i].getPosition();
+            const Vec2 fixed_position = fixed_solver.objects.data[i].getPosition();
+            const float error = MathVec2::length(float_position - fixed_position);
+            error_sum += error;
+            max_error  = std::max(max_error, error);
+            height_sum[0] += float_position.y;
+            height_sum[1] += fixed_position.y;
+        }
+        std::cout << label << " mean error " << std::scientific << std::setprecision(2) << error_sum / options.count
+                  << "  max error " << max_error << std::defaultfloat << std::setprecision(6)
+                  << "  mean height " << height_sum[0] / options.count << " / " << height_sum[1] / options.count << std::endl;
+    };
+
+    const float dt = 1.0f / 60.0f;
+    std::cout << options.count << " objects, world " << world_side << ", " << options.iterations << " steps, "
+              << options.threads << " threads" << std::endl;
+    std::cout << "object size  float " << sizeof(PhysicObject) << " bytes, fixed " << sizeof(QuantizedObject) << " bytes" << std::endl;
+    float_solver.update(dt);
+    fixed_solver.update(dt);
+    compare("after 1 step   ");
+
+    double float_ms = 0.0;
+    double fixed_ms = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        auto start = BenchClock::now();
+        float_solver.update(dt);
+        float_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        fixed_solver.update(dt);
+        fixed_ms += getElapsedMs(start);
+    }
+    // Individual trajectories diverge in piles, the mean height tells if the piles behave the same
+    compare("after all steps");
+    std::cout << "float " << float_ms / options.iterations << " ms/step, fixed " << fixed_ms / options.iterations << " ms/step" << std::endl;
+}
+
+// Compares user forces applied in their own passes against the same forces fused in the integration
+void benchKernels(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{1000, 1000};
+    const auto initializer = [&](uint32_t i, civ::ID, auto& obj) {
+        obj.setPosition({2.0f + to<float>(i % 996), 2.0f + to<float>(i / 996) * 1000.0f / to<float>(options.count / 996 + 1)});
+    };
+    PhysicSolver separate_solver{world_size, thread_pool};
+    PhysicSolver fused_solver{world_size, thread_pool};
+    separate_solver.createObjects(options.count, initializer);
+    fused_solver.createObjects(options.count, initializer);
+    // A single sub step so that both versions apply the forces once per step
+    separate_solver.sub_steps = 1;
+    fused_solver.sub_steps    = 1;
+
+    const kernels::Attractor  attractor{{500.0f, 500.0f}, 2000.0f};
+    const kernels::ForceField wind{{0.0f, 0.0f}, {1000.0f, 300.0f}, {40.0f, 0.0f}};
+    kernels::ColorBySpeed separate_colors{separate_solver.color_indices};
+    kernels::ColorBySpeed fused_colors{fused_solver.color_indices};
+
+    const float dt = 1.0f / 60.0f;
+    double separate_ms = 0.0;
+    double fused_ms    = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        auto start = BenchClock::now();
+        // Each force in its own parallel pass, before the step as the user code would do without kernels
+        thread_pool.dispatch(options.count, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t k{begin}; k < end; ++k) {
+                PhysicObject& obj = separate_solver.objects.data[k];
+                attractor(k, obj, dt);
+            }
+        });
+        thread_pool.dispatch(options.count, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t k{begin}; k < end; ++k) {
+                PhysicObject& obj = separate_solver.objects.data[k];
+                wind(k, obj, dt);
+            }
+        });
+        separate_solver.update(dt);
+        thread_pool.dispatch(options.count, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t k{begin}; k < end; ++k) {
+                separate_colors(k, separate_solver.objects.data[k], dt);
+            }
+        });
+        separate_ms += getElapsedMs(start);
+
+        start = BenchClock::now();
+        fused_solver.update(dt, attractor, wind, fused::afterIntegration(fused_colors));
+        fused_ms += getElapsedMs(start);
+    }
+    std::cout << options.count << " objects, " << options.iterations << " steps, " << options.threads << " threads" << std::endl;
+    std::cout << "separate passes " << separate_ms / options.iterations << " ms/step, fused " << fused_ms / options.iterations << " ms/step" << std::endl;
+
+    // The renderer's vertices have to follow the colors set by the kernel
+    const Palette palette = Palette::createRainbow();
+    const auto countStaleColors = [&](bool dynamic_colors) {
+        RenderFrame frame;
+        render::writeAllParticles(frame, fused_solver, thread_pool, palette, 1, dynamic_colors);
+        fused_solver.update(dt, attractor, wind, fused::afterIntegration(fused_colors));
+        render::writeAllParticles(frame, fused_solver, thread_pool, palette, 1, dynamic_colors);
+        uint64_t stale{0};
+        for (uint64_t i{0}; i < fused_solver.objects.size(); ++i) {
+            stale += !(frame.objects_vertices[i * 4].color == palette[fused_solver.color_indices[i]]);
+        }
+        return stale;
+    };
+    const uint64_t static_stale  = countStaleColors(false);
+    const uint64_t dynamic_stale = countStaleColors(true);
+    std::cout << "stale colors drawn: " << static_stale << " with static colors, " << dynamic_stale << " with dynamic colors"
+              << (dynamic_stale ? " (ERROR)" : "") << std::endl;
+}
+
+// Mixed object sizes in a multi-level grid against a single grid with cells as large as the largest objects
+void benchPolydisperse(const BenchOptions& options)
+{
+    using SingleGridSolver = BasicPhysicSolver<ObjectStorage<SizedObject>, BasicMultiLevelGrid<1, 32, 4>>;
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{1000, 1000};
+    // Rows of objects of radius 0.5, 1 and 2 (85%, 12% and 3%)
+    std::vector<Vec2>  positions(options.count);
+    std::vector<float> radii(options.count);
+    Vec2 cursor{3.0f, 3.0f};
+    for (uint32_t i{0}; i < options.count; ++i) {
+        const float p = RNGf::get();
+        radii[i] = p < 0.85f ? 0.5f : (p < 0.97f ? 1.0f : 2.0f);
+        if (cursor.x + 2.0f * radii[i] > to<float>(world_size.x) - 3.0f) {
+            cursor = {3.0f, cursor.y + 4.1f};
+        }
+        positions[i] = cursor + Vec2{radii[i], 2.0f};
+        cursor.x += 2.0f * radii[i] + 0.05f;
+    }
+    const auto initializer = [&](uint32_t i, civ::ID, SizedObject& obj) {
+        obj.setPosition(positions[i]);
+        obj.setRadius(radii[i]);
+    };
+    PolydisperseSolver multi_solver{world_size, thread_pool};
+    SingleGridSolver   single_solver{world_size, thread_pool};
+    multi_solver.createObjects(options.count, initializer);
+    single_solver.createObjects(options.count, initializer);
+
+    const float dt = 1.0f / 60.0f;
+    double multi_ms  = 0.0;
+    double single_ms = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        auto start = BenchClock::now();
+        multi_solver.update(dt);
+        multi_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        single_solver.update(dt);
+        single_ms += getElapsedMs(start);
+    }
+    std::cout << options.count << " objects, " << options.iterations << " steps, " << options.threads << " threads" << std::endl;
+    std::cout << "objects per level";
+    for (const auto& level : multi_solver.grid.levels) {
+        std::cout << " " << level.objects_count;
+    }
+    std::cout << std::endl;
+    std::cout << "multi-level " << multi_ms / options.iterations << " ms/step, single grid " << single_ms / options.iterations << " ms/step" << std::endl;
+}
+
+// Square cloth of linked objects falling on the floor, measures the coloring and the links solving
+void benchLinks(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const auto  side = to<uint32_t>(std::sqrt(to<float>(options.count)));
+    const float spacing = 1.5f;
+    const auto  world_side = to<int32_t>(to<float>(side) * spacing) + 16;
+    PhysicSolver solver{{world_side, world_side}, thread_pool};
+    const civ::SlotRange range = solver.createObjects(side * side, [&](uint32_t i, civ::ID, PhysicObject& obj) {
+        obj.setPosition({8.0f + to<float>(i % side) * spacing, 8.0f + to<float>(i / side) * spacing});
+    });
+    // Structural and shear links
+    for (uint32_t y{0}; y < side; ++y) {
+        for (uint32_t x{0}; x < side; ++x) {
+            const auto index = to<uint32_t>(range.first + y * side + x);
+            if (x + 1 < side) {
+                solver.constraints.add(index, index + 1, spacing);
+            }
+            if (y + 1 < side) {
+                solver.constraints.add(index, index + side, spacing);
+            }
+            if (x + 1 < side && y + 1 < side) {
+                solver.constraints.add(index, index + side + 1, spacing * std::sqrt(2.0f), 0.5f);
+            }
+        }
+    }
+    auto start = BenchClock::now();
+    solver.constraints.color(solver.objects.size());
+    const double color_ms = getElapsedMs(start);
+
+    const float dt = 1.0f / 60.0f;
+    double links_ms  = 0.0;
+    double update_ms = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        start = BenchClock::now();
+        solver.constraints.solve(thread_pool, solver.objects);
+        links_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        solver.update(dt);
+        update_ms += getElapsedMs(start);
+    }
+    double max_error = 0.0;
+    for (uint32_t i{0}; i < solver.constraints.size(); ++i) {
+        const Vec2 v = solver.objects.data[solver.constraints.first[i]].position - solver.objects.data[solver.constraints.second[i]].position;
+        if (solver.constraints.stiffness[i] == 1.0f) {
+            max_error = std::max(max_error, to<double>(std::abs(MathVec2::length(v) - solver.constraints.length[i])));
+        }
+    }
+    std::cout << side * side << " objects, " << solver.constraints.size() << " links, " << options.iterations << " steps, "
+              << options.threads << " threads" << std::endl;
+    std::cout << solver.constraints.getColorsCount() << " colors in " << color_ms << " ms" << std::endl;
+    std::cout << "links pass " << links_ms / options.iterations << " ms, step " << update_ms / options.iterations
+              << " ms (" << solver.sub_steps << " links passes), max rigid link error " << max_error << std::endl;
+}
+
+// Same settled pile with and without sleeping, then a rope resting on it is dragged sideways.
+// Sleeping is approximate, the pile and the rope have to end close to the reference without sleep
+void benchSleep(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    // Hexagonal packing from wall to wall at the bottom of the world, the pile is at rest from the start
+    constexpr float row_height = 0.866f;
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(options.count) * row_height * 2.0f))) + 4;
+    const auto per_row    = to<uint32_t>(world_side - 5);
+    const uint32_t rope_count = 40;
+    // The rope lies in the hollows of the last full row, at rest as well
+    const uint32_t rope_row   = options.count / per_row - 1;
+    const float    rope_x     = 3.0f + (rope_row % 2 ? 0.5f : 0.0f) + to<float>((per_row - rope_count) / 2);
+    const float    rope_y     = to<float>(world_side) - 2.5f - to<float>(rope_row + 1) * row_height;
+    PhysicSolver reference{{world_side, world_side}, thread_pool};
+    PhysicSolver sleeping{{world_side, world_side}, thread_pool};
+    sleeping.setSleepEnabled(true);
+    for (PhysicSolver* solver : {&reference, &sleeping}) {
+        solver->createObjects(options.count, [&](uint32_t i, civ::ID, PhysicObject& obj) {
+            const uint32_t row = i / per_row;
+            const float    x   = 2.5f + to<float>(i % per_row) + (row % 2 ? 0.5f : 0.0f);
+            obj.setPosition({x, to<float>(world_side) - 2.5f - to<float>(row) * row_height});
+        });
+        const civ::SlotRange rope = solver->createObjects(rope_count, [&](uint32_t i, civ::ID, PhysicObject& obj) {
+            obj.setPosition({rope_x + to<float>(i), rope_y});
+        });
+        for (uint32_t i{0}; i + 1 < rope_count; ++i) {
+            solver->constraints.add(to<uint32_t>(rope.first + i), to<uint32_t>(rope.first + i + 1), 1.0f);
+        }
+    }
+
+    // The pile takes a few hundred steps to come to rest and fall asleep, it is only timed once settled
+    const float dt = 1.0f / 60.0f;
+    for (uint32_t i{2 * options.iterations}; i--;) {
+        reference.update(dt);
+        sleeping.update(dt);
+    }
+    double reference_ms = 0.0;
+    double sleeping_ms  = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        auto start = BenchClock::now();
+        reference.update(dt);
+        reference_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        sleeping.update(dt);
+        sleeping_ms += getElapsedMs(start);
+    }
+    uint32_t asleep_objects{0};
+    for (uint32_t i{0}; i < options.count; ++i) {
+        asleep_objects += sleeping.sleep_grid.isAsleep(sleeping.objects.data[i].position);
+    }
+    const auto compare = [&](uint32_t first, uint32_t count, float& mean_error, float& max_error) {
+        double error_sum = 0.0;
+        max_error = 0.0f;
+        for (uint32_t i{first}; i < first + count; ++i) {
+            const float error = MathVec2::length(reference.objects.data[i].position - sleeping.objects.data[i].position);
+            error_sum += error;
+            max_error  = std::max(max_error, error);
+        }
+        mean_error = to<float>(error_sum / count);
+    };
+    float pile_mean_error;
+    float pile_max_error;
+    compare(0, options.count, pile_mean_error, pile_max_error);
+
+    // The first object of the rope is dragged, the links have to wake the tiles the rope rests on
+    const uint32_t drag_steps = 120;
+    const float    drag_speed = 0.1f;
+    std::vector<Vec2> reference_start(rope_count);
+    std::vector<Vec2> sleeping_start(rope_count);
+    for (uint32_t i{0}; i < rope_count; ++i) {
+        reference_start[i] = reference.objects.data[options.count + i].position;
+        sleeping_start[i]  = sleeping.objects.data[options.count + i].position;
+    }
+    for (uint32_t i{0}; i < drag_steps; ++i) {
+        // The handle is placed on its path each step, the links would pull it back otherwise
+        const Vec2 offset{drag_speed * to<float>(i + 1), 0.0f};
+        reference.objects.data[options.count].setPosition(reference_start[0] + offset);
+        reference.update(dt);
+        sleeping.objects.data[options.count].setPosition(sleeping_start[0] + offset);
+        sleeping.update(dt);
+    }
+    double reference_motion = 0.0;
+    double sleeping_motion  = 0.0;
+    for (uint32_t i{0}; i < rope_count; ++i) {
+        reference_motion += MathVec2::length(reference.objects.data[options.count + i].position - reference_start[i]);
+        sleeping_motion  += MathVec2::length(sleeping.objects.data[options.count + i].position - sleeping_start[i]);
+    }
+    float rope_mean_error;
+    float rope_max_error;
+    compare(options.count, rope_count, rope_mean_error, rope_max_error);
+
+    std::cout << options.count << " objects and a rope of " << rope_count << ", " << options.iterations << " steps after "
+              << 2 * options.iterations << " settling steps, " << options.threads << " threads" << std::endl;
+    std::cout << "without sleep " << reference_ms / options.iterations << " ms/step, with sleep " << sleeping_ms / options.iterations
+              << " ms/step, " << asleep_objects << " objects of the pile asleep" << std::endl;
+    std::cout << "settled pile difference: mean " << pile_mean_error << " max " << pile_max_error << std::endl;
+    // Both ropes follow the handle on a bumpy ground and take different paths, a rope kept asleep would stay behind
+    const bool valid = sleeping_motion > 0.75 * reference_motion;
+    std::cout << "dragged rope difference: mean " << rope_mean_error << " max " << rope_max_error << ", mean rope motion "
+              << reference_motion / rope_count << " without sleep " << sleeping_motion / rope_count << " with sleep"
+              << (valid ? "" : " (ERROR)") << std::endl;
+}
+
+// Objects falling through a board of pegs and slopes, compares the steps with and without obstacles
+void benchObstacles(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{1000, 1000};
+    const auto initializer = [&](uint32_t i, civ::ID, PhysicObject& obj) {
+        obj.setPosition({4.0f + to<float>(i % 990), 4.0f + to<float>(i / 990) * 1.1f});
+    };
+    PhysicSolver free_solver{world_size, thread_pool};
+    PhysicSolver obstacles_solver{world_size, thread_pool};
+    free_solver.createObjects(options.count, initializer);
+    obstacles_solver.createObjects(options.count, initializer);
+    // The disc of the particles texture, as an image obstacle above the circles
+    sf::Image  circle_image;
+    const bool image_loaded = circle_image.loadFromFile("res/circle.png");
+    const Vec2 image_position{450.0f, 240.0f};
+    const Vec2 image_size{100.0f, 100.0f};
+
+    auto start = BenchClock::now();
+    DistanceField& obstacles = obstacles_solver.obstacles;
+    for (uint32_t y{0}; y < 12; ++y) {
+        for (uint32_t x{0}; x < 24; ++x) {
+            const float offset = (y % 2) ? 20.0f : 0.0f;
+            obstacles.addCircle({offset + 20.0f + 40.0f * to<float>(x), 400.0f + 30.0f * to<float>(y)}, 4.0f);
+        }
+    }
+    obstacles.addCapsule({0.0f, 800.0f}, {450.0f, 880.0f}, 3.0f);
+    obstacles.addCapsule({1000.0f, 800.0f}, {550.0f, 880.0f}, 3.0f);
+    obstacles.addPolygon({{470.0f, 950.0f}, {530.0f, 950.0f}, {500.0f, 900.0f}});
+    if (image_loaded) {
+        obstacles.addImage(circle_image, image_position, image_size);
+    }
+    const double bake_ms = getElapsedMs(start);
+
+    const float dt = 1.0f / 60.0f;
+    double free_ms      = 0.0;
+    double obstacles_ms = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        start = BenchClock::now();
+        free_solver.update(dt);
+        free_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        obstacles_solver.update(dt);
+        obstacles_ms += getElapsedMs(start);
+    }
+    uint32_t inside{0};
+    for (const PhysicObject& obj : obstacles_solver.objects) {
+        inside += obstacles.sample(obj.position).distance < 0.0f;
+    }
+    std::cout << options.count << " objects, " << options.iterations << " steps, " << options.threads << " threads" << std::endl;
+    std::cout << "field " << obstacles.distances.width << "x" << obstacles.distances.height << " baked in " << bake_ms << " ms" << std::endl;
+    std::cout << "without obstacles " << free_ms / options.iterations << " ms/step, with obstacles " << obstacles_ms / options.iterations
+              << " ms/step, " << inside << " objects inside obstacles" << std::endl;
+
+    if (!image_loaded) {
+        std::cout << "res/circle.png not found, the image obstacle is not checked" << std::endl;
+        return;
+    }
+    // The baked image has to match the circle it represents close to its edge, and be clamped to the band inside
+    const Vec2  center = image_position + image_size * 0.5f;
+    const float radius = image_size.x * 0.5f;
+    float max_error = 0.0f;
+    const auto x_min = to<int32_t>(image_position.x * obstacles.inv_cell_size);
+    const auto y_min = to<int32_t>(image_position.y * obstacles.inv_cell_size);
+    const auto x_max = to<int32_t>((image_position.x + image_size.x) * obstacles.inv_cell_size);
+    const auto y_max = to<int32_t>((image_position.y + image_size.y) * obstacles.inv_cell_size);
+    for (int32_t y{y_min}; y <= y_max; ++y) {
+        for (int32_t x{x_min}; x <= x_max; ++x) {
+            const float expected = MathVec2::length(Vec2{to<float>(x), to<float>(y)} * obstacles.cell_size - center) - radius;
+            if (std::abs(expected) < obstacles.band - obstacles.cell_size) {
+                max_error = std::max(max_error, std::abs(obstacles.distances.get(x, y) - expected));
+            }
+        }
+    }
+    const float center_distance = obstacles.sample(center).distance;
+    const bool  valid           = max_error <= obstacles.cell_size && center_distance >= -obstacles.band;
+    std::cout << "image obstacle: max error " << max_error << " against the analytic circle, distance at its center "
+              << center_distance << (valid ? "" : " (ERROR)") << std::endl;
+}
+
+// Objects attracted by each other through the particle mesh, compares the mesh update with the full step
+void benchLongRange(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{1000, 1000};
+    PhysicSolver solver{world_size, thread_pool};
+    solver.gravity = {0.0f, 0.0f};
+    solver.createObjects(options.count, [&](uint32_t, civ::ID, PhysicObject& obj) {
+        obj.setPosition({RNGf::getRange(100.0f, 900.0f), RNGf::getRange(100.0f, 900.0f)});
+    });
+    solver.long_range.strength = 20.0f;
+
+    const float dt = 1.0f / 60.0f;
+    double mesh_ms = 0.0;
+    double step_ms = 0.0;
+    for (uint32_t i{options.iterations}; i--;) {
+        auto start = BenchClock::now();
+        solver.long_range.update(thread_pool, solver.objects);
+        mesh_ms += getElapsedMs(start);
+        start = BenchClock::now();
+        solver.update(dt);
+        step_ms += getElapsedMs(start);
+    }
+    double distance_sum = 0.0;
+    for (const PhysicObject& obj : solver.objects) {
+        distance_sum += MathVec2::length(obj.position - Vec2{500.0f, 500.0f});
+    }
+    std::cout << options.count << " objects, mesh " << solver.long_range.width << "x" << solver.long_range.height << ", "
+              << options.iterations << " steps, " << options.threads << " threads" << std::endl;
+    std::cout << "mesh update " << mesh_ms / options.iterations << " ms, step " << step_ms / options.iterations
+              << " ms, mean distance to the center " << distance_sum / to<double>(options.count) << std::endl;
+}
+
+// Radius and nearest neighbors queries against a linear scan of the objects
+void benchQueries(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const IVec2 world_size{1000, 1000};
+    PhysicSolver solver{world_size, thread_pool};
+    solver.createObjects(options.count, [&](uint32_t, civ::ID, PhysicObject& obj) {
+        obj.setPosition({RNGf::getRange(2.0f, 998.0f), RNGf::getRange(2.0f, 998.0f)});
+    });
+    solver.update(1.0f / 60.0f);
+
+    const uint32_t queries_count = options.iterations * 100;
+    const float    radius        = 5.0f;
+    const uint32_t capacity      = 256;
+    std::vector<Vec2>    centers(queries_count);
+    std::vector<civ::ID> ids(to<uint64_t>(queries_count) * capacity);
+    std::vector<IDSpan>  results(queries_count);
+    for (Vec2& center : centers) {
+        center = {RNGf::getRange(10.0f, 990.0f), RNGf::getRange(10.0f, 990.0f)};
+    }
+
+    auto start = BenchClock::now();
+    uint64_t found{0};
+    for (uint32_t i{0}; i < queries_count; ++i) {
+        results[i] = solver.queryRadius(centers[i], radius, &ids[to<uint64_t>(i) * capacity], capacity);
+        found += results[i].found;
+    }
+    const double single_ms = getElapsedMs(start);
+
+    start = BenchClock::now();
+    solver.queryRadiusBatch(centers.data(), queries_count, radius, ids.data(), capacity, results.data());
+    const double batch_ms = getElapsedMs(start);
+
+    start = BenchClock::now();
+    std::array<civ::ID, 16> neighbors{};
+    for (uint32_t i{0}; i < queries_count; ++i) {
+        solver.queryNearest(centers[i], 16, 50.0f, neighbors.data());
+    }
+    const double nearest_ms = getElapsedMs(start);
+
+    // Linear scans on a few queries, as the tools did before
+    const uint32_t scan_count = std::min(queries_count, 100u);
+    uint64_t missed{0};
+    start = BenchClock::now();
+    for (uint32_t i{0}; i < scan_count; ++i) {
+        uint32_t scan_found{0};
+        for (const PhysicObject& obj : solver.objects) {
+            scan_found += MathVec2::length2(obj.position - centers[i]) <= radius * radius;
+        }
+        missed += scan_found - results[i].found;
+    }
+    const double scan_ms = getElapsedMs(start);
+
+    std::cout << options.count << " objects, " << queries_count << " queries of radius " << radius << ", " << options.threads << " threads" << std::endl;
+    std::cout << "radius  " << single_ms * 1000.0 / queries_count << " us/query, batch " << batch_ms * 1000.0 / queries_count
+              << " us/query, " << to<double>(found) / queries_count << " objects/query" << std::endl;
+    std::cout << "nearest " << nearest_ms * 1000.0 / queries_count << " us/query (k = 16)" << std::endl;
+    std::cout << "scan    " << scan_ms * 1000.0 / scan_count << " us/query, " << missed << " objects missed by the grid" << std::endl;
+}
+
+// Collision pass on column major and tiled grids, objects are in random order like after a long simulation
+void benchLayout(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(options.count) / 0.8f))) + 4;
+    const IVec2 world_size{world_side, world_side};
+    std::vector<Vec2> positions(options.count);
+    for (Vec2& position : positions) {
+        position = {RNGf::getRange(2.0f, to<float>(world_side) - 2.0f), RNGf::getRange(2.0f, to<float>(world_side) - 2.0f)};
+    }
+    using TiledSolver = BasicPhysicSolver<ObjectStorage<PhysicObject>, TiledCollisionGrid>;
+    PhysicSolver column_solver{world_size, thread_pool};
+    TiledSolver  tiled_solver{world_size, thread_pool};
+    column_solver.createObjects(positions);
+    tiled_solver.createObjects(positions);
+    column_solver.update(1.0f / 60.0f);
+    tiled_solver.update(1.0f / 60.0f);
+
+    const auto measure = [&](auto& solver) {
+        double ms = 0.0;
+        for (uint32_t i{options.iterations}; i--;) {
+            solver.addObjectsToGrid();
+            const auto start = BenchClock::now();
+            solver.solveCollisions();
+            ms += getElapsedMs(start);
+        }
+        return ms / options.iterations;
+    };
+    std::cout << options.count << " objects, world " << world_side << ", " << options.threads << " threads" << std::endl;
+    std::cout << "column major " << measure(column_solver) << " ms/pass" << std::endl;
+    std::cout << "tiled 8x8    " << measure(tiled_solver) << " ms/pass" << std::endl;
+}
+
+void printMemoryReport()
+{
+    const auto toMB = [](uint64_t bytes) { return to<double>(bytes) / (1024.0 * 1024.0); };
+    std::cout << std::left << std::setw(12) << "  subsystem" << std::right << std::setw(10) << "MB" << std::setw(10) << "peak MB"
+              << std::setw(11) << "mapped MB" << std::setw(9) << "huge MB" << std::setw(13) << "allocations" << std::endl;
+    for (uint32_t i{0}; i < mem::tags_count; ++i) {
+        const auto       tag   = static_cast<mem::Tag>(i);
+        const mem::Usage usage = mem::getUsage(tag);
+        std::cout << "  " << std::left << std::setw(10) << mem::getTagName(tag) << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << toMB(usage.bytes) << std::setw(10) << toMB(usage.peak_bytes) << std::setw(11) << toMB(usage.mapped_bytes)
+                  << std::setw(9) << toMB(usage.huge_bytes) << std::setw(13) << usage.allocations << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+// Same scene with 4 KB pages and with transparent huge pages, with the memory used by each subsystem
+void benchMemory(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(options.count) / 0.8f))) + 4;
+    const IVec2 world_size{world_side, world_side};
+    const auto run = [&](mem::HugePages huge_pages, const char* label) {
+        mem::setHugePages(huge_pages);
+        // Peaks and allocations of this run only
+        mem::resetCounters();
+        PhysicSolver solver{world_size, thread_pool};
+        solver.createObjects(options.count, [&](uint32_t, civ::ID, PhysicObject& obj) {
+            obj.setPosition({RNGf::getRange(2.0f, to<float>(world_side) - 2.0f), RNGf::getRange(2.0f, to<float>(world_side) - 2.0f)});
+        });
+        SoftwareRenderer renderer{solver, thread_pool, 1920, 1080};
+        solver.update(1.0f / 60.0f);
+        renderer.render();
+        const auto start = BenchClock::now();
+        for (uint32_t i{options.iterations}; i--;) {
+            solver.update(1.0f / 60.0f);
+        }
+        std::cout << label << getElapsedMs(start) / options.iterations << " ms/step" << std::endl;
+        printMemoryReport();
+    };
+    std::cout << options.count << " objects, world " << world_side << ", " << options.threads << " threads" << std::endl;
+    run(mem::HugePages::Disabled,    "4 KB pages ");
+    run(mem::HugePages::Transparent, "huge pages ");
+}
+
+// Hardware counters of each update phase, per thread values are written to profile.csv
+void benchProfile(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(options.count) / 0.8f))) + 4;
+    PhysicSolver solver{{world_side, world_side}, thread_pool};
+    solver.createObjects(options.count, [&](uint32_t, civ::ID, PhysicObject& obj) {
+        obj.setPosition({RNGf::getRange(2.0f, to<float>(world_side) - 2.0f), RNGf::getRange(2.0f, to<float>(world_side) - 2.0f)});
+    });
+    solver.update(1.0f / 60.0f);
+
+    perf::PhaseProfiler profiler{getUpdatePhaseNames(), options.threads};
+    solver.setProfiler(&profiler);
+    const auto start = BenchClock::now();
+    for (uint32_t i{options.iterations}; i--;) {
+        solver.update(1.0f / 60.0f);
+    }
+    const double step_ms = getElapsedMs(start) / options.iterations;
+    solver.setProfiler(nullptr);
+
+    std::cout << options.count << " objects, world " << world_side << ", " << options.threads << " threads, "
+              << step_ms << " ms/step" << std::endl;
+    if (!profiler.isAvailable(perf::Event::Cycles)) {
+        std::cout << "hardware counters unavailable, only the CPU time is measured" << std::endl;
+    }
+    // Per step values, the imbalance is the busiest worker's CPU time over the workers' mean
+    const auto iterations = to<double>(options.iterations);
+    std::cout << std::left << std::setw(13) << "phase" << std::right << std::setw(9) << "ms" << std::setw(10) << "cpu ms"
+              << std::setw(11) << "imbalance" << std::setw(13) << "Mcycles" << std::setw(7) << "IPC"
+              << std::setw(13) << "LLC misses" << std::setw(15) << "branch misses" << std::endl;
+    for (uint32_t phase{0}; phase < profiler.getPhasesCount(); ++phase) {
+        const perf::Counters total = profiler.getPhaseTotal(phase);
+        uint64_t max_worker_ns{0};
+        uint64_t sum_worker_ns{0};
+        for (uint32_t thread{0}; thread + 1 < profiler.getThreadsCount(); ++thread) {
+            const uint64_t ns = profiler.getCounters(phase, thread)[perf::Event::TaskClock];
+            max_worker_ns  = std::max(max_worker_ns, ns);
+            sum_worker_ns += ns;
+        }
+        const double mean_worker_ns = to<double>(sum_worker_ns) / options.threads;
+        const auto printEvent = [&](perf::Event event, double scale, int32_t width) {
+            std::cout << std::setw(width);
+            if (profiler.isAvailable(event)) {
+                std::cout << to<double>(total[event]) * scale / iterations;
+            } else {
+                std::cout << "-";
+            }
+        };
+        std::cout << std::left << std::setw(13) << profiler.getPhaseName(phase) << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(9) << profiler.getTimeMs(phase) / iterations;
+        printEvent(perf::Event::TaskClock, 1e-6, 10);
+        std::cout << std::setw(11) << (mean_worker_ns > 0.0 ? to<double>(max_worker_ns) / mean_worker_ns : 0.0);
+        printEvent(perf::Event::Cycles, 1e-6, 13);
+        std::cout << std::setw(7);
+        if (profiler.isAvailable(perf::Event::Instructions) && total[perf::Event::Cycles]) {
+            std::cout << to<double>(total[perf::Event::Instructions]) / to<double>(total[perf::Event::Cycles]);
+        } else {
+            std::cout << "-";
+        }
+        std::cout << std::setprecision(0);
+        printEvent(perf::Event::CacheMisses, 1.0, 13);
+        printEvent(perf::Event::BranchMisses, 1.0, 15);
+        std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+    std::ofstream csv{"profile.csv"};
+    profiler.writeCSV(csv);
+    std::cout << "per thread counters written to profile.csv" << std::endl;
+}
+
+// Objects dropped by the grid and contacts of a settling pile, with the cost of the counting
+void benchHealth(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(options.count) / 0.8f))) + 4;
+    std::vector<Vec2> positions(options.count);
+    for (Vec2& position : positions) {
+        position = {RNGf::getRange(2.0f, to<float>(world_side) - 2.0f), RNGf::getRange(2.0f, to<float>(world_side) - 2.0f)};
+    }
+    // Sub steps of the run with the counters
+    SubStepHealth total;
+    SubStepHealth worst;
+    uint64_t      sub_steps_count{0};
+    const auto run = [&](bool health_enabled) {
+        PhysicSolver solver{{world_side, world_side}, thread_pool};
+        solver.createObjects(positions);
+        solver.setHealthEnabled(health_enabled);
+        double ms = 0.0;
+        for (uint32_t i{options.iterations}; i--;) {
+            const auto start = BenchClock::now();
+            solver.update(1.0f / 60.0f);
+            ms += getElapsedMs(start);
+            for (const SubStepHealth& sub_step : solver.getHealth().sub_steps) {
+                ++sub_steps_count;
+                total.cell_overflows += sub_step.cell_overflows;
+                total.out_of_bounds  += sub_step.out_of_bounds;
+                total.contacts.merge(sub_step.contacts);
+                if (sub_step.contacts.max_penetration >= worst.contacts.max_penetration) {
+                    worst = sub_step;
+                }
+            }
+        }
+        return ms / options.iterations;
+    };
+    const double disabled_ms = run(false);
+    const double enabled_ms  = run(true);
+    const auto   sub_steps   = to<double>(std::max(sub_steps_count, uint64_t{1}));
+    std::cout << options.count << " objects, world " << world_side << ", " << options.threads << " threads" << std::endl;
+    std::cout << "without counters " << disabled_ms << " ms/step, with counters " << enabled_ms << " ms/step" << std::endl;
+    std::cout << "per sub step: " << to<double>(total.cell_overflows) / sub_steps << " cell overflows, "
+              << to<double>(total.out_of_bounds) / sub_steps << " out of bounds, "
+              << to<double>(total.contacts.tested) / sub_steps << " contacts tested, "
+              << to<double>(total.contacts.resolved) / sub_steps << " resolved" << std::endl;
+    std::cout << "penetration: mean " << total.getMeanPenetration() << ", worst sub step max " << worst.contacts.max_penetration
+              << " mean " << worst.getMeanPenetration() << std::endl;
+}
+
+// Value below which the given fraction of the values are, the values are reordered
+double getPercentile(std::vector<double>& values, double fraction)
+{
+    const auto index = std::min(to<uint64_t>(fraction * to<double>(values.size())), to<uint64_t>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+struct CapacityProbe
+{
+    uint32_t count         = 0;
+    uint32_t warmup_frames = 0;
+    double   p50_ms        = 0.0;
+    double   p99_ms        = 0.0;
+};
+
+// Frame times of a settled pile of count objects once they stopped changing
+CapacityProbe probeCapacity(tp::ThreadPool& thread_pool, uint32_t count, uint32_t measured_frames)
+{
+    // Hexagonal packing of the objects at the bottom of a world twice as high as the pile
+    constexpr float row_height = 0.866f;
+    const auto world_side = to<int32_t>(std::ceil(std::sqrt(to<float>(count) * row_height * 2.0f))) + 4;
+    const auto per_row    = to<uint32_t>(world_side - 5);
+    PhysicSolver solver{{world_side, world_side}, thread_pool};
+    solver.createObjects(count, [&](uint32_t i, civ::ID, PhysicObject& obj) {
+        const uint32_t row = i / per_row;
+        const float    x   = 2.5f + to<float>(i % per_row) + (row % 2 ? 0.5f : 0.0f);
+        obj.setPosition({x + RNGf::getRange(-0.01f, 0.01f), to<float>(world_side) - 2.5f - to<float>(row) * row_height});
+    });
+
+    const float dt = 1.0f / 60.0f;
+    std::vector<double> frame_times;
+    const auto runFrames = [&](uint32_t frames_count) {
+        frame_times.clear();
+        for (uint32_t i{frames_count}; i--;) {
+            const auto start = BenchClock::now();
+            solver.update(dt);
+            frame_times.push_back(getElapsedMs(start));
+        }
+    };
+    // Steady state once the median of two consecutive windows differs by less than 5%
+    constexpr uint32_t window_size = 30;
+    constexpr uint32_t max_windows = 20;
+    CapacityProbe probe;
+    probe.count = count;
+    double last_median = 0.0;
+    for (uint32_t window{0}; window < max_windows; ++window) {
+        runFrames(window_size);
+        probe.warmup_frames += window_size;
+        const double median = getPercentile(frame_times, 0.5);
+        if (window && std::abs(median - last_median) < 0.05 * last_median) {
+            break;
+        }
+        last_median = median;
+    }
+    runFrames(measured_frames);
+    probe.p50_ms = getPercentile(frame_times, 0.5);
+    probe.p99_ms = getPercentile(frame_times, 0.99);
+    return probe;
+}
+
+// Largest number of objects whose median frame time fits the frame budget, found by bisection.
+// The search starts from count and stops once the interval is within 1% of the result
+void benchCapacity(const BenchOptions& options)
+{
+    tp::ThreadPool thread_pool(options.threads);
+    const double budget_ms = 1000.0 / to<double>(std::max(options.fps, 1u));
+    const uint32_t measured_frames = std::max(options.iterations, 10u);
+    std::cout << "budget " << budget_ms << " ms (" << options.fps << " fps), " << options.threads << " threads, "
+              << measured_frames << " measured frames per probe" << std::endl;
+    const auto probe = [&](uint32_t count) {
+        const CapacityProbe result = probeCapacity(thread_pool, count, measured_frames);
+        std::cout << "  " << std::setw(9) << count << " objects  p50 " << std::fixed << std::setprecision(2) << std::setw(8) << result.p50_ms
+                  << " ms  p99 " << std::setw(8) << result.p99_ms << " ms  after " << result.warmup_frames << " warmup frames  "
+                  << (result.p50_ms <= budget_ms ? "fits" : "over") << std::defaultfloat << std::setprecision(6) << std::endl;
+        return result;
+    };
+    // Bounds: the largest count fitting the budget and the smallest one over it
+    constexpr uint32_t max_count = 1u << 28;
+    CapacityProbe fitting;
+    uint32_t      over{max_count};
+    const CapacityProbe first = probe(std::min(std::max(options.count, 1000u), max_count / 2));
+    if (first.p50_ms <= budget_ms) {
+        fitting = first;
+        while (over == max_count && fitting.count < max_count / 2) {
+            const uint32_t count = fitting.count * 2;
+            const CapacityProbe result = probe(count);
+            if (result.p50_ms <= budget_ms) {
+                fitting = result;
+            } else {
+                over = count;
+            }
+        }
+    } else {
+        over = first.count;
+    }
+    while (over - fitting.count > std::max(fitting.count / 100, 100u)) {
+        const uint32_t count = fitting.count + (over - fitting.count) / 2;
+        const CapacityProbe result = probe(count);
+        if (result.p50_ms <= budget_ms) {
+            fitting = result;
+        } else {
+            over = count;
+        }
+    }
+    if (!fitting.count) {
+        std::cout << "no object count fits the budget" << std::endl;
+        return;
+    }
+    std::cout << "capacity " << fitting.count << " objects at " << options.fps << " fps with " << options.threads << " threads, p50 "
+              << fitting.p50_ms << " ms, p99 " << fitting.p99_ms << " ms" << std::endl;
+}
+
+void printUsage()
+{
+    std::cout << "Usage: VerletBench <command> [options]\n"
+              << "Commands:\n"
+              << "  integrator    Compares the integration kernels against the legacy loop\n"
+              << "  spawn         Compares single and bulk objects creation\n"
+              << "  churn         Compares immediate and deferred objects removal\n"
+              << "  raster        Measures the software renderer at 1080p\n"
+              << "  quantized     Compares fixed point and float positions\n"
+              << "  kernels       Compares user forces in separate passes and fused in the integration\n"
+              << "  polydisperse  Compares the multi-level grid and a single grid with mixed object sizes\n"
+              << "  links         Measures the distance constraints on a cloth\n"
+              << "  sleep         Compares a settled pile and a dragged rope with and without sleeping\n"
+              << "  obstacles     Compares steps with and without distance field obstacles\n"
+              << "  longrange     Measures the particle mesh long range forces\n"
+              << "  queries       Measures the spatial queries against linear scans\n"
+              << "  layout        Compares the collision pass on column major and tiled grids\n"
+              << "  memory        Compares 4 KB and huge pages, then prints the memory used by each subsystem\n"
+              << "  profile       Measures the hardware counters of each update phase\n"
+              << "  health        Counts the objects dropped by the grid and the contacts, with the cost of the counting\n"
+              << "  capacity      Searches the largest number of objects updated within the frame budget\n"
+              << "Options:\n"
+              << "  --count N       Number of objects\n"
+              << "  --iterations N  Number of measured iterations\n"
+              << "  --threads N     Number of worker threads\n"
+              << "  --fps N         Frame budget of the capacity search" << std::endl;
+}
+
+// Strict unsigned parsing, negative values, values above the uint32_t limit and trailing characters are rejected
+bool parseUint32(const std::string& str, uint32_t& value)
+{
+    // stoull skips leading spaces and wraps negative values, the value has to start with a digit
+    if (str.empty() || str[0] < '0' || str[0] > '9') {
+        return false;
+    }
+    try {
+        size_t pos = 0;
+        const unsigned long long parsed = std::stoull(str, &pos);
+        if (pos != str.size() || parsed > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        value = static_cast<uint32_t>(parsed);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    int32_t i{1};
+    if (i < argc && argv[i][0] != '-') {
+        options.command = argv[i++];
+    }
+    for (; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        // Malformed values print the usage instead of throwing
+        uint32_t value = 0;
+        if (!parseUint32(argv[++i], value)) {
+            return false;
+        }
+        if (arg == "--count") {
+            options.count = value;
+        } else if (arg == "--iterations") {
+            options.iterations = value;
+        } else if (arg == "--threads") {
+            options.threads = std::max(1u, value);
+        } else if (arg == "--fps") {
+            options.fps = std::max(1u, value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    if (options.command == "integrator") {
+        benchIntegrator(options);
+    } else if (options.command == "spawn") {
+        benchSpawn(options);
+    } else if (options.command == "churn") {
+        benchChurn(options);
+    } else if (options.command == "raster") {
+        benchRaster(options);
+    } else if (options.command == "quantized") {
+        benchQuantized(options);
+    } else if (options.command == "kernels") {
+        benchKernels(options);
+    } else if (options.command == "polydisperse") {
+        benchPolydisperse(options);
+    } else if (options.command == "links") {
+        benchLinks(options);
+    } else if (options.command == "sleep") {
+        benchSleep(options);
+    } else if (options.command == "obstacles") {
+        benchObstacles(options);
+    } else if (options.command == "longrange") {
+        benchLongRange(options);
+    } else if (options.command == "queries") {
+        benchQueries(options);
+    } else if (options.command == "layout") {
+        benchLayout(options);
+    } else if (options.command == "memory") {
+        benchMemory(options);
+    } else if (options.command == "profile") {
+        benchProfile(options);
+    } else if (options.command == "health") {
+        benchHealth(options);
+    } else if (options.command == "capacity") {
+        benchCapacity(options);
+    } else {
+        printUsage();
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,351 @@
+#pragma once
+#include <new>
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+// Memory of the large buffers (objects, grids, renderer buffers), all blocks are 64 bytes aligned:
+// - small blocks come from the heap
+// - medium blocks, like the pages of the paged arrays, are carved from 2 MB chunks shared by the blocks
+//   of a subsystem, a chunk is released once all its blocks are freed
+// - large blocks get their own mapping
+// Chunks and large blocks are aligned on huge pages and can be backed by them, which saves most of
+// the TLB misses of the solver passes over hundreds of MB. Usage is tracked per subsystem.
+namespace mem
+{
+
+constexpr uint64_t alignment       = 64;
+constexpr uint64_t page_size       = uint64_t{1} << 12;
+constexpr uint64_t huge_page_size  = uint64_t{1} << 21;
+constexpr uint64_t chunk_size      = huge_page_size;
+// Smaller blocks come from the heap, larger ones get their own mapping
+constexpr uint64_t min_chunk_block = uint64_t{1} << 14;
+constexpr uint64_t max_chunk_block = chunk_size / 2;
+
+enum class Tag : uint8_t
+{
+    Objects,
+    Grid,
+    Renderer,
+    Count
+};
+
+constexpr uint32_t tags_count = static_cast<uint32_t>(Tag::Count);
+
+inline const char* getTagName(Tag tag)
+{
+    constexpr const char* names[tags_count] = {"objects", "grid", "renderer"};
+    return names[static_cast<uint32_t>(tag)];
+}
+
+enum class HugePages : uint8_t
+{
+    // Regular 4 KB pages
+    Disabled,
+    // madvise(MADV_HUGEPAGE), the kernel backs the mappings with huge pages when it can
+    Transparent,
+    // MAP_HUGETLB from the reserved huge pages pool, Transparent when the pool is empty
+    Explicit
+};
+
+struct Usage
+{
+    // Bytes requested by the containers
+    uint64_t bytes        = 0;
+    uint64_t peak_bytes   = 0;
+    // Bytes of the chunks and large blocks mappings
+    uint64_t mapped_bytes = 0;
+    // Mapped bytes in huge pages, or advised to be with HugePages::Transparent
+    uint64_t huge_bytes   = 0;
+    uint64_t allocations  = 0;
+};
+
+
+class Arena
+{
+public:
+    static Arena& get()
+    {
+        static Arena arena;
+        return arena;
+    }
+
+    // Only affects the next mappings
+    void setHugePages(HugePages mode)
+    {
+        m_huge_pages = mode;
+    }
+
+    [[nodiscard]]
+    HugePages getHugePages() const
+    {
+        return m_huge_pages;
+    }
+
+    void* allocate(uint64_t size, Tag tag)
+    {
+        TagState& state = m_tags[static_cast<uint32_t>(tag)];
+        const uint64_t bytes = state.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        uint64_t peak = state.peak_bytes.load(std::memory_order_relaxed);
+        while (bytes > peak && !state.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+        state.allocations.fetch_add(1, std::memory_order_relaxed);
+        if (size < min_chunk_block) {
+            return ::operator new(size, std::align_val_t{alignment});
+        }
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        if (size > max_chunk_block) {
+            const uint64_t address = map(size, tag, false);
+            return reinterpret_cast<void*>(address);
+        }
+        return allocateInChunk(getBlockSize(size), tag);
+    }
+
+    void deallocate(void* ptr, uint64_t size, Tag tag)
+    {
+        m_tags[static_cast<uint32_t>(tag)].bytes.fetch_sub(size, std::memory_order_relaxed);
+        if (size < min_chunk_block) {
+            ::operator delete(ptr, std::align_val_t{alignment});
+            return;
+        }
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        // Last mapping starting before the block
+        auto it = --m_mappings.upper_bound(reinterpret_cast<uint64_t>(ptr));
+        Mapping& mapping = it->second;
+        if (mapping.is_chunk) {
+            if (--mapping.blocks_count) {
+                return;
+            }
+            // The current chunk is kept and reused from its start
+            if (m_current_chunks[static_cast<uint32_t>(tag)] == it->first) {
+                mapping.used = 0;
+                return;
+            }
+        }
+        unmap(it);
+    }
+
+    [[nodiscard]]
+    Usage getUsage(Tag tag) const
+    {
+        const TagState& state = m_tags[static_cast<uint32_t>(tag)];
+        Usage usage;
+        usage.bytes        = state.bytes.load(std::memory_order_relaxed);
+        usage.peak_bytes   = state.peak_bytes.load(std::memory_order_relaxed);
+        usage.mapped_bytes = state.mapped_bytes.load(std::memory_order_relaxed);
+        usage.huge_bytes   = state.huge_bytes.load(std::memory_order_relaxed);
+        usage.allocations  = state.allocations.load(std::memory_order_relaxed);
+        return usage;
+    }
+
+    // Starts a new measurement: the peaks restart from the current bytes and the allocations from 0.
+    // Bytes and mappings are the live state, they are kept
+    void resetCounters()
+    {
+        for (TagState& state : m_tags) {
+            state.peak_bytes.store(state.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            state.allocations.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct TagState
+    {
+        std::atomic<uint64_t> bytes        = 0;
+        std::atomic<uint64_t> peak_bytes   = 0;
+        std::atomic<uint64_t> mapped_bytes = 0;
+        std::atomic<uint64_t> huge_bytes   = 0;
+        std::atomic<uint64_t> allocations  = 0;
+    };
+
+    struct Mapping
+    {
+        uint64_t size         = 0;
+        // Chunks only, bytes carved from the start and number of blocks still in use
+        uint64_t used         = 0;
+        uint32_t blocks_count = 0;
+        Tag      tag          = Tag::Objects;
+        bool     is_chunk     = false;
+        bool     huge         = false;
+    };
+
+    std::atomic<HugePages>              m_huge_pages = HugePages::Transparent;
+    std::array<TagState, tags_count>    m_tags;
+    // Mappings by address, only accessed for the blocks of the chunks and the large blocks
+    std::map<uint64_t, Mapping>         m_mappings;
+    // Address of the chunk currently carved for each tag, 0 if none
+    std::array<uint64_t, tags_count>    m_current_chunks = {};
+    std::mutex                          m_mutex;
+
+    Arena() = default;
+
+    static uint64_t getBlockSize(uint64_t size)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* allocateInChunk(uint64_t size, Tag tag)
+    {
+        uint64_t& current = m_current_chunks[static_cast<uint32_t>(tag)];
+        if (current) {
+            Mapping& chunk = m_mappings[current];
+            if (chunk.used + size > chunk.size) {
+                // Full, released with its last block
+                const uint64_t full = current;
+                current = 0;
+                if (!chunk.blocks_count) {
+                    unmap(m_mappings.find(full));
+                }
+            }
+        }
+        if (!current) {
+            current = map(chunk_size, tag, true);
+        }
+        Mapping& chunk = m_mappings[current];
+        const uint64_t address = current + chunk.used;
+        chunk.used += size;
+        ++chunk.blocks_count;
+        return reinterpret_cast<void*>(address);
+    }
+
+    uint64_t map(uint64_t size, Tag tag, bool is_chunk)
+    {
+        Mapping mapping;
+        mapping.tag      = tag;
+        mapping.is_chunk = is_chunk;
+        mapping.size     = (size + page_size - 1) & ~(page_size - 1);
+        void* address = nullptr;
+#if defined(__linux__)
+        const HugePages mode = m_huge_pages;
+        if (mode == HugePages::Explicit) {
+            const uint64_t huge_size = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+            address = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (address == MAP_FAILED) {
+                address = nullptr;
+            } else {
+                mapping.size = huge_size;
+                mapping.huge = true;
+            }
+        }
+        if (!address) {
+            // Mapped larger then trimmed to start on a huge page
+            const uint64_t mapped_size = mapping.size + huge_page_size;
+            void* raw = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            const auto raw_address = reinterpret_cast<uint64_t>(raw);
+            const uint64_t aligned = (raw_address + huge_page_size - 1) & ~(huge_page_size - 1);
+            if (aligned > raw_address) {
+                munmap(raw, aligned - raw_address);
+            }
+            const uint64_t tail = raw_address + mapped_size - (aligned + mapping.size);
+            if (tail) {
+                munmap(reinterpret_cast<void*>(aligned + mapping.size), tail);
+            }
+            address = reinterpret_cast<void*>(aligned);
+            if (mode != HugePages::Disabled) {
+                mapping.huge = madvise(address, mapping.size, MADV_HUGEPAGE) == 0;
+            }
+        }
+#else
+        address = ::operator new(mapping.size, std::align_val_t{huge_page_size});
+#endif
+        TagState& state = m_tags[static_cast<uint32_t>(tag)];
+        state.mapped_bytes.fetch_add(mapping.size, std::memory_order_relaxed);
+        if (mapping.huge) {
+            state.huge_bytes.fetch_add(mapping.size, std::memory_order_relaxed);
+        }
+        const auto key = reinterpret_cast<uint64_t>(address);
+        m_mappings[key] = mapping;
+        return key;
+    }
+
+    void unmap(std::map<uint64_t, Mapping>::iterator it)
+    {
+        const Mapping& mapping = it->second;
+        TagState& state = m_tags[static_cast<uint32_t>(mapping.tag)];
+        state.mapped_bytes.fetch_sub(mapping.size, std::memory_order_relaxed);
+        if (mapping.huge) {
+            state.huge_bytes.fetch_sub(mapping.size, std::memory_order_relaxed);
+        }
+#if defined(__linux__)
+        munmap(reinterpret_cast<void*>(it->first), mapping.size);
+#else
+        ::operator delete(reinterpret_cast<void*>(it->first), std::align_val_t{huge_page_size});
+#endif
+        m_mappings.erase(it);
+    }
+};
+
+
+inline void setHugePages(HugePages mode)
+{
+    Arena::get().setHugePages(mode);
+}
+
+[[nodiscard]]
+inline Usage getUsage(Tag tag)
+{
+    return Arena::get().getUsage(tag);
+}
+
+inline void resetCounters()
+{
+    Arena::get().resetCounters();
+}
+
+
+// Standard allocator over the arena, the tag gives the subsystem the memory is accounted to
+template<typename T, Tag TTag>
+struct Allocator
+{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = Allocator<U, TTag>;
+    };
+
+    Allocator() = default;
+
+    // Implicit, containers convert their allocator to the one of their nodes
+    template<typename U>
+    Allocator(const Allocator<U, TTag>&)
+    {}
+
+    T* allocate(std::size_t count)
+    {
+        return static_cast<T*>(Arena::get().allocate(count * sizeof(T), TTag));
+    }
+
+    void deallocate(T* ptr, std::size_t count)
+    {
+        Arena::get().deallocate(ptr, count * sizeof(T), TTag);
+    }
+
+    template<typename U>
+    bool operator==(const Allocator<U, TTag>&) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const Allocator<U, TTag>&) const
+    {
+        return false;
+    }
+};
+
+template<typename T, Tag TTag>
+using Vector = std::vector<T, Allocator<T, TTag>>;
+
+}
@@ -1,11 +1,206 @@
 #pragma once
 #include <vector>
 #include <array>
+#include <cstdint>
+#include "arena.hpp"
 
 
-template<typename T>
+struct GridCoords
+{
+	int32_t x, y;
+};
+
+// 3x3 neighborhood of a cell: column x, then x + 1 and x - 1, each from y - 1 to y + 1
+constexpr int32_t grid_stencil[9][2] = {{0, -1}, {0, 0}, {0, 1}, {1, -1}, {1, 0}, {1, 1}, {-1, -1}, {-1, 0}, {-1, 1}};
+
+
+// Memory layouts of Grid, cell (x, y) is stored at data[getIndex(x, y)].
+// Stripes are contiguous ranges of whole lines of cells, cells of two stripes that are
+// not next to each other are never neighbors. getStencil gives the indices of the
+// grid_stencil cells around cell (x, y) stored at index, which has to be at least one cell
+// away from the borders. forEachCell calls callback(index, x, y) for the cells of data[start, end)
+// in memory order, start and end being stripe boundaries.
+
+// Rows one after the other
+struct RowMajorLayout
+{
+	static uint32_t getSize(int32_t width, int32_t height)
+	{
+		return static_cast<uint32_t>(width * height);
+	}
+
+	static uint32_t getIndex(int32_t x, int32_t y, int32_t width, int32_t)
+	{
+		return static_cast<uint32_t>(y * width + x);
+	}
+
+	static GridCoords getCoords(uint32_t index, int32_t width, int32_t)
+	{
+		return {static_cast<int32_t>(index % width), static_cast<int32_t>(index / width)};
+	}
+
+	static void getStencil(uint32_t index, int32_t, int32_t, int32_t width, int32_t, uint32_t* indices)
+	{
+		for (uint32_t k{0}; k < 9; ++k) {
+			indices[k] = index + grid_stencil[k][1] * width + grid_stencil[k][0];
+		}
+	}
+
+	template<typename TCallback>
+	static void forEachCell(uint32_t start, uint32_t end, int32_t width, int32_t, TCallback&& callback)
+	{
+		uint32_t index = start;
+		for (auto y{static_cast<int32_t>(start / width)}; index < end; ++y) {
+			for (int32_t x{0}; x < width; ++x) {
+				callback(index++, x, y);
+			}
+		}
+	}
+
+	static int32_t getStripesCount(int32_t, int32_t height)
+	{
+		return height;
+	}
+
+	static int32_t getStripeSize(int32_t width, int32_t)
+	{
+		return width;
+	}
+};
+
+// Columns one after the other
+struct ColumnMajorLayout
+{
+	static uint32_t getSize(int32_t width, int32_t height)
+	{
+		return static_cast<uint32_t>(width * height);
+	}
+
+	static uint32_t getIndex(int32_t x, int32_t y, int32_t, int32_t height)
+	{
+		return static_cast<uint32_t>(x * height + y);
+	}
+
+	static GridCoords getCoords(uint32_t index, int32_t, int32_t height)
+	{
+		return {static_cast<int32_t>(index / height), static_cast<int32_t>(index % height)};
+	}
+
+	static void getStencil(uint32_t index, int32_t, int32_t, int32_t, int32_t height, uint32_t* indices)
+	{
+		for (uint32_t k{0}; k < 9; ++k) {
+			indices[k] = index + grid_stencil[k][0] * height + grid_stencil[k][1];
+		}
+	}
+
+	template<typename TCallback>
+	static void forEachCell(uint32_t start, uint32_t end, int32_t, int32_t height, TCallback&& callback)
+	{
+		uint32_t index = start;
+		for (auto x{static_cast<int32_t>(start / height)}; index < end; ++x) {
+			for (int32_t y{0}; y < height; ++y) {
+				callback(index++, x, y);
+			}
+		}
+	}
+
+	static int32_t getStripesCount(int32_t width, int32_t)
+	{
+		return width;
+	}
+
+	static int32_t getStripeSize(int32_t, int32_t height)
+	{
+		return height;
+	}
+};
+
+// Square tiles of 2^TTileSizeLog cells, stored column of tiles by column of tiles, the cells of a tile
+// are stored column by column. Most 3x3 neighborhoods lie in a single tile, a few KB apart at most
+// whatever the size of the grid. The grid is padded to a whole number of tiles.
+template<int32_t TTileSizeLog = 3>
+struct TiledLayout
+{
+	static constexpr int32_t  tile_size_log = TTileSizeLog;
+	static constexpr int32_t  tile_size     = 1 << TTileSizeLog;
+	static constexpr int32_t  tile_mask     = tile_size - 1;
+	static constexpr uint32_t tile_cells    = tile_size * tile_size;
+
+	static int32_t getTilesCount(int32_t size)
+	{
+		return (size + tile_mask) >> tile_size_log;
+	}
+
+	static uint32_t getSize(int32_t width, int32_t height)
+	{
+		return static_cast<uint32_t>(getTilesCount(width) * getTilesCount(height)) * tile_cells;
+	}
+
+	static uint32_t getIndex(int32_t x, int32_t y, int32_t, int32_t height)
+	{
+		const auto tile = static_cast<uint32_t>((x >> tile_size_log) * getTilesCount(height) + (y >> tile_size_log));
+		return (tile << (2 * tile_size_log)) + static_cast<uint32_t>(((x & tile_mask) << tile_size_log) + (y & tile_mask));
+	}
+
+	static GridCoords getCoords(uint32_t index, int32_t, int32_t height)
+	{
+		const uint32_t tile    = index >> (2 * tile_size_log);
+		const auto     tiles_y = static_cast<uint32_t>(getTilesCount(height));
+		const auto     cell    = static_cast<int32_t>(index & (tile_cells - 1));
+		return {static_cast<int32_t>(tile / tiles_y) * tile_size + (cell >> tile_size_log),
+		        static_cast<int32_t>(tile % tiles_y) * tile_size + (cell & tile_mask)};
+	}
+
+	static void getStencil(uint32_t index, int32_t x, int32_t y, int32_t, int32_t height, uint32_t* indices)
+	{
+		// Steps to the neighbor columns and rows, larger when crossing a tile border
+		const uint32_t tiles_column = static_cast<uint32_t>(getTilesCount(height)) * tile_cells;
+		const uint32_t step_x_min   = (x & tile_mask) == 0         ? tiles_column - tile_mask * tile_size : tile_size;
+		const uint32_t step_x_max   = (x & tile_mask) == tile_mask ? tiles_column - tile_mask * tile_size : tile_size;
+		const uint32_t step_y_min   = (y & tile_mask) == 0         ? tile_cells - tile_mask : 1;
+		const uint32_t step_y_max   = (y & tile_mask) == tile_mask ? tile_cells - tile_mask : 1;
+		const uint32_t columns[3]   = {index, index + step_x_max, index - step_x_min};
+		for (uint32_t k{0}; k < 3; ++k) {
+			indices[3 * k]     = columns[k] - step_y_min;
+			indices[3 * k + 1] = columns[k];
+			indices[3 * k + 2] = columns[k] + step_y_max;
+		}
+	}
+
+	// Tile by tile, a single division per tile
+	template<typename TCallback>
+	static void forEachCell(uint32_t start, uint32_t end, int32_t, int32_t height, TCallback&& callback)
+	{
+		const auto tiles_y = static_cast<uint32_t>(getTilesCount(height));
+		uint32_t   index   = start;
+		for (uint32_t tile{start >> (2 * tile_size_log)}; index < end; ++tile) {
+			const auto x = static_cast<int32_t>(tile / tiles_y) * tile_size;
+			const auto y = static_cast<int32_t>(tile % tiles_y) * tile_size;
+			for (int32_t cell_x{0}; cell_x < tile_size; ++cell_x) {
+				for (int32_t cell_y{0}; cell_y < tile_size; ++cell_y) {
+					callback(index++, x + cell_x, y + cell_y);
+				}
+			}
+		}
+	}
+
+	static int32_t getStripesCount(int32_t width, int32_t)
+	{
+		return getTilesCount(width);
+	}
+
+	static int32_t getStripeSize(int32_t, int32_t height)
+	{
+		return getTilesCount(height) * static_cast<int32_t>(tile_cells);
+	}
+};
+
+
+template<typename T, typename TLayout = RowMajorLayout>
 struct Grid
 {
+	using Layout = TLayout;
+
 	struct HitPoint
 	{
 		T* cell;
@@ -18,7 +213,7 @@ struct Grid
 	};
 
 	int32_t width, height;
-	std::vector<T> data;
+	mem::Vector<T, mem::Tag::Grid> data;
 
 	Grid()
 		: width(0)
@@ -29,7 +224,46 @@ struct Grid
 		: width(width_)
 		, height(height_)
 	{
-		data.resize(width * height);
+		data.resize(TLayout::getSize(width, height));
+	}
+
+	uint32_t getIndex(int32_t x, int32_t y) const
+	{
+		return TLayout::getIndex(x, y, width, height);
+	}
+
+	GridCoords getCoords(uint32_t index) const
+	{
+		return TLayout::getCoords(index, width, height);
+	}
+
+	// Indices of the grid_stencil cells around (x, y)
+	void getStencil(int32_t x, int32_t y, uint32_t* indices) const
+	{
+		TLayout::getStencil(getIndex(x, y), x, y, width, height, indices);
+	}
+
+	void getStencil(uint32_t index, int32_t x, int32_t y, uint32_t* indices) const
+	{
+		TLayout::getStencil(index, x, y, width, height, indices);
+	}
+
+	// Stencil iteration, callback(index, x, y) for the cells of data[start, end) in memory order
+	template<typename TCallback>
+	void forEachCell(uint32_t start, uint32_t end, TCallback&& callback) const
+	{
+		TLayout::forEachCell(start, end, width, height, callback);
+	}
+
+	// Data is made of getStripesCount() ranges of getStripeSize() cells, see the layouts
+	int32_t getStripesCount() const
+	{
+		return TLayout::getStripesCount(width, height);
+	}
+
+	int32_t getStripeSize() const
+	{
+		return TLayout::getStripeSize(width, height);
 	}
 
 	int32_t mod(int32_t dividend, int32_t divisor) const
@@ -51,7 +285,7 @@ struct Grid
 
 	const T& get(int32_t x, int32_t y) const
 	{
-		return data[y * width + x];
+		return data[getIndex(x, y)];
 	}
 
 	template<typename Vec2Type>
@@ -79,7 +313,7 @@ struct Grid
 
 	T& get(int32_t x, int32_t y)
 	{
-		return data[y * width + x];
+		return data[getIndex(x, y)];
 	}
 
 	template<typename Vec2Type>
@@ -90,6 +324,6 @@ struct Grid
 
 	void set(int32_t x, int32_t y, const T& obj)
 	{
-		data[y * width + x] = obj;
+		data[getIndex(x, y)] = obj;
 	}
 };
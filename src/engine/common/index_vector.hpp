@@ -1,6 +1,8 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <algorithm>
+#include "paged_array.hpp"
 
 
 namespace civ
@@ -8,7 +10,10 @@ namespace civ
 
 using ID = uint64_t;
 
-template<typename T>
+// Data index of removed objects in compaction remaps
+constexpr uint64_t InvalidIndex = ~uint64_t{0};
+
+template<typename T, template<typename> class TStorage = ContiguousStorage>
 struct Ref;
 
 template<typename T>
@@ -68,7 +73,23 @@ struct SlotMetadata
 };
 
 
-template<typename T>
+// Contiguous range of data indices
+struct SlotRange
+{
+    uint64_t first;
+    uint64_t count;
+
+    [[nodiscard]]
+    uint64_t end() const
+    {
+        return first + count;
+    }
+};
+
+
+// Slot map keeping its objects contiguous, objects are accessed by ID or by their position in data.
+// TStorage is the underlying array type, PagedStorage avoids relocating the objects when growing
+template<typename T, template<typename> class TStorage = ContiguousStorage>
 struct Vector : public GenericProvider
 {
     Vector()
@@ -91,17 +112,31 @@ struct Vector : public GenericProvider
     template<typename... Args>
     ID                 emplace_back(Args&&... args);
     ID                 push_back(const T& obj);
+    // Reserves count slots at once, the returned data indices still have to be initialized
+    SlotRange          allocate(uint64_t count);
     [[nodiscard]]
     ID                 getNextID() const;
     void               erase(ID id);
     template<typename TPredicate>
     void               remove_if(TPredicate&& f);
     void               clear();
+    // Deferred removal, objects are only flagged and stay in place until the next compaction.
+    // Flagging different objects from different threads is safe
+    void               markForRemoval(ID id);
+    void               markForRemovalAt(uint64_t i);
+    [[nodiscard]]
+    bool               isMarkedForRemoval(ID id) const;
+    // Removes all the flagged objects at once and returns a remap from old to new data indices
+    // (InvalidIndex for removed objects). The remap is empty if nothing was removed.
+    // dispatch(count, callback(start, end)) is used to split the work, typically tp::ThreadPool::dispatch
+    template<typename TDispatcher>
+    const std::vector<uint64_t>& compact(TDispatcher&& dispatch);
+    const std::vector<uint64_t>& compact();
     // Data access by ID
     T&                 operator[](ID id);
     const T&           operator[](ID id) const;
     // Returns a standalone object allowing access to the underlying data
-    Ref<T>             getRef(ID id);
+    Ref<T, TStorage>   getRef(ID id);
     template<typename U>
     PRef<U>            getPRef(ID id);
     // Returns the data at a specific place in the data vector (not an ID)
@@ -115,10 +150,10 @@ struct Vector : public GenericProvider
     ObjectSlot<T>      getSlotAt(uint64_t i);
     ObjectSlotConst<T> getSlotAt(uint64_t i) const;
     // Iterators
-    typename std::vector<T>::iterator       begin();
-    typename std::vector<T>::iterator       end();
-    typename std::vector<T>::const_iterator begin() const;
-    typename std::vector<T>::const_iterator end() const;
+    typename TStorage<T>::iterator       begin();
+    typename TStorage<T>::iterator       end();
+    typename TStorage<T>::const_iterator begin() const;
+    typename TStorage<T>::const_iterator end() const;
     // Number of objects in the provider
     [[nodiscard]]
     uint64_t size() const;
@@ -127,11 +162,27 @@ struct Vector : public GenericProvider
     ID getValidityID(ID id) const;
 
 public:
-    std::vector<T>            data;
-    std::vector<uint64_t>     ids;
-    std::vector<SlotMetadata> metadata;
+    TStorage<T>               data;
+    TStorage<uint64_t>        ids;
+    TStorage<SlotMetadata>    metadata;
+    TStorage<uint8_t>         removal_flags;
     uint64_t                  data_size;
     uint64_t                  op_count;
+    // Incremented each time existing objects change of data index (erase, compaction, clear)
+    uint64_t                  layout_version = 0;
+
+    // Compaction buffers, kept to avoid allocations
+    struct CompactionBuffers
+    {
+        std::vector<uint64_t> removed_count;
+        std::vector<uint64_t> holes_count;
+        std::vector<uint64_t> movers_count;
+        std::vector<uint64_t> holes;
+        std::vector<uint64_t> movers;
+        std::vector<uint64_t> removed_ids;
+        std::vector<uint64_t> remap;
+    };
+    CompactionBuffers compaction;
 
     [[nodiscard]]
     bool          isFull() const;
@@ -155,25 +206,51 @@ public:
     template<class U> friend struct PRef;
 };
 
-template<typename T>
+template<typename T, template<typename> class TStorage>
 template<typename ...Args>
-inline uint64_t Vector<T>::emplace_back(Args&& ...args)
+inline uint64_t Vector<T, TStorage>::emplace_back(Args&& ...args)
 {
     const Slot slot = getSlot();
     new(&data[slot.data_id]) T(std::forward<Args>(args)...);
     return slot.id;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::push_back(const T& obj)
+template<typename T, template<typename> class TStorage>
+inline uint64_t Vector<T, TStorage>::push_back(const T& obj)
 {
     const Slot slot = getSlot();
     data[slot.data_id] = obj;
     return slot.id;
 }
 
-template<typename T>
-inline void Vector<T>::erase(ID id)
+template<typename T, template<typename> class TStorage>
+inline SlotRange Vector<T, TStorage>::allocate(uint64_t count)
+{
+    const SlotRange range{data_size, count};
+    const uint64_t capacity = data.size();
+    // Reuse free slots first
+    const uint64_t reused_end = std::min(range.end(), capacity);
+    for (uint64_t i{data_size}; i < reused_end; ++i) {
+        metadata[i].op_id = op_count++;
+        removal_flags[i]  = 0;
+    }
+    // Then create the missing ones with a single allocation
+    if (range.end() > capacity) {
+        data.resize(range.end());
+        ids.resize(range.end());
+        metadata.resize(range.end());
+        removal_flags.resize(range.end());
+        for (uint64_t i{capacity}; i < range.end(); ++i) {
+            ids[i]      = i;
+            metadata[i] = {i, op_count++};
+        }
+    }
+    data_size = range.end();
+    return range;
+}
+
+template<typename T, template<typename> class TStorage>
+inline void Vector<T, TStorage>::erase(ID id)
 {
     // Retrieve the object position in data
     const uint64_t data_index = ids[id];
@@ -186,191 +263,341 @@ inline void Vector<T>::erase(ID id)
     const uint64_t last_id = metadata[data_size].rid;
     std::swap(data[data_size], data[data_index]);
     std::swap(metadata[data_size], metadata[data_index]);
+    std::swap(removal_flags[data_size], removal_flags[data_index]);
+    // The erased object may have been marked, its flag must not remove the next object of this slot
+    removal_flags[data_size] = 0;
     std::swap(ids[last_id], ids[id]);
     // Invalidate the operation ID
     metadata[data_size].op_id = ++op_count;
+    ++layout_version;
 }
 
-template<typename T>
-inline T& Vector<T>::operator[](ID id)
+template<typename T, template<typename> class TStorage>
+inline T& Vector<T, TStorage>::operator[](ID id)
 {
     return const_cast<T&>(getAt(id));
 }
 
-template<typename T>
-inline const T& Vector<T>::operator[](ID id) const
+template<typename T, template<typename> class TStorage>
+inline const T& Vector<T, TStorage>::operator[](ID id) const
 {
     return getAt(id);
 }
 
-template<typename T>
-inline ObjectSlot<T> Vector<T>::getSlotAt(uint64_t i)
+template<typename T, template<typename> class TStorage>
+inline ObjectSlot<T> Vector<T, TStorage>::getSlotAt(uint64_t i)
 {
     return ObjectSlot<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline ObjectSlotConst<T> Vector<T>::getSlotAt(uint64_t i) const
+template<typename T, template<typename> class TStorage>
+inline ObjectSlotConst<T> Vector<T, TStorage>::getSlotAt(uint64_t i) const
 {
     return ObjectSlotConst<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline Ref<T> Vector<T>::getRef(ID id)
+template<typename T, template<typename> class TStorage>
+inline Ref<T, TStorage> Vector<T, TStorage>::getRef(ID id)
 {
-    return Ref<T>(id, this, metadata[ids[id]].op_id);
+    return Ref<T, TStorage>(id, this, metadata[ids[id]].op_id);
 }
 
-template<typename T>
+template<typename T, template<typename> class TStorage>
 template<typename U>
-PRef<U> Vector<T>::getPRef(ID id) {
+PRef<U> Vector<T, TStorage>::getPRef(ID id) {
     return PRef<U>{id, this, metadata[ids[id]].op_id};
 }
 
-template<typename T>
-inline T& Vector<T>::getDataAt(uint64_t i)
+template<typename T, template<typename> class TStorage>
+inline T& Vector<T, TStorage>::getDataAt(uint64_t i)
 {
     return data[i];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getID(uint64_t i) const
+template<typename T, template<typename> class TStorage>
+inline uint64_t Vector<T, TStorage>::getID(uint64_t i) const
 {
     return metadata[i].rid;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::size() const
+template<typename T, template<typename> class TStorage>
+inline uint64_t Vector<T, TStorage>::size() const
 {
     return data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::begin()
+template<typename T, template<typename> class TStorage>
+inline typename TStorage<T>::iterator Vector<T, TStorage>::begin()
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::end()
+template<typename T, template<typename> class TStorage>
+inline typename TStorage<T>::iterator Vector<T, TStorage>::end()
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::begin() const
+template<typename T, template<typename> class TStorage>
+inline typename TStorage<T>::const_iterator Vector<T, TStorage>::begin() const
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::end() const
+template<typename T, template<typename> class TStorage>
+inline typename TStorage<T>::const_iterator Vector<T, TStorage>::end() const
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline bool Vector<T>::isFull() const
+template<typename T, template<typename> class TStorage>
+inline bool Vector<T, TStorage>::isFull() const
 {
     return data_size == data.size();
 }
 
-template<typename T>
-inline Slot Vector<T>::createNewSlot()
+template<typename T, template<typename> class TStorage>
+inline Slot Vector<T, TStorage>::createNewSlot()
 {
     data.emplace_back();
     ids.push_back(data_size);
     metadata.push_back({data_size, op_count++});
+    removal_flags.push_back(0);
     return { data_size, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getFreeSlot()
+template<typename T, template<typename> class TStorage>
+inline Slot Vector<T, TStorage>::getFreeSlot()
 {
     const uint64_t reuse_id = metadata[data_size].rid;
     metadata[data_size].op_id = op_count++;
+    removal_flags[data_size]  = 0;
     return { reuse_id, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getSlot()
+template<typename T, template<typename> class TStorage>
+inline Slot Vector<T, TStorage>::getSlot()
 {
     const Slot slot = isFull() ? createNewSlot() : getFreeSlot();
     ++data_size;
     return slot;
 }
 
-template<typename T>
-inline SlotMetadata& Vector<T>::getMetadataAt(ID id)
+template<typename T, template<typename> class TStorage>
+inline SlotMetadata& Vector<T, TStorage>::getMetadataAt(ID id)
 {
     return metadata[getDataID(id)];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getDataID(ID id) const
+template<typename T, template<typename> class TStorage>
+inline uint64_t Vector<T, TStorage>::getDataID(ID id) const
 {
     return ids[id];
 }
 
-template<typename T>
-inline const T& Vector<T>::getAt(ID id) const
+template<typename T, template<typename> class TStorage>
+inline const T& Vector<T, TStorage>::getAt(ID id) const
 {
     return data[getDataID(id)];
 }
 
-template<typename T>
-inline bool Vector<T>::isValid(ID id, ID validity) const
+template<typename T, template<typename> class TStorage>
+inline bool Vector<T, TStorage>::isValid(ID id, ID validity) const
 {
     return validity == metadata[getDataID(id)].op_id;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getOperationID(ID id) const
+template<typename T, template<typename> class TStorage>
+inline uint64_t Vector<T, TStorage>::getOperationID(ID id) const
 {
     return metadata[getDataID(id)].op_id;
 }
 
-template<typename T>
+template<typename T, template<typename> class TStorage>
 template<typename TPredicate>
-void Vector<T>::remove_if(TPredicate&& f)
+void Vector<T, TStorage>::remove_if(TPredicate&& f)
 {
-    for (uint64_t data_index{ 0 }; data_index < data_size;) {
+    for (uint64_t data_index{ 0 }; data_index < data_size; ++data_index) {
         if (f(data[data_index])) {
-            erase(metadata[data_index].rid);
+            markForRemovalAt(data_index);
+        }
+    }
+    compact();
+}
+
+template<typename T, template<typename> class TStorage>
+inline void Vector<T, TStorage>::markForRemoval(ID id)
+{
+    markForRemovalAt(ids[id]);
+}
+
+template<typename T, template<typename> class TStorage>
+inline void Vector<T, TStorage>::markForRemovalAt(uint64_t i)
+{
+    removal_flags[i] = 1;
+}
+
+template<typename T, template<typename> class TStorage>
+inline bool Vector<T, TStorage>::isMarkedForRemoval(ID id) const
+{
+    return removal_flags[ids[id]];
+}
+
+template<typename T, template<typename> class TStorage>
+const std::vector<uint64_t>& Vector<T, TStorage>::compact()
+{
+    return compact([](uint32_t count, auto&& callback) { callback(0, count); });
+}
+
+template<typename T, template<typename> class TStorage>
+template<typename TDispatcher>
+const std::vector<uint64_t>& Vector<T, TStorage>::compact(TDispatcher&& dispatch)
+{
+    // The data is split in fixed blocks so that each pass can be run in parallel
+    constexpr uint64_t block_size = 4096;
+    const uint64_t old_size    = data_size;
+    const auto     block_count = static_cast<uint32_t>((old_size + block_size - 1) / block_size);
+    CompactionBuffers& buffers = compaction;
+    buffers.remap.clear();
+    buffers.removed_count.assign(block_count, 0);
+    buffers.holes_count.assign(block_count, 0);
+    buffers.movers_count.assign(block_count, 0);
+    const auto for_each_block = [&](auto&& callback) {
+        dispatch(block_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t b{start}; b < end; ++b) {
+                callback(b, b * block_size, std::min(old_size, (b + 1) * block_size));
+            }
+        });
+    };
+
+    for_each_block([&](uint32_t b, uint64_t first, uint64_t last) {
+        uint64_t count = 0;
+        for (uint64_t i{first}; i < last; ++i) {
+            count += removal_flags[i];
         }
-        else {
-            data_index++;
+        buffers.removed_count[b] = count;
+    });
+    uint64_t removed_total = 0;
+    for (const uint64_t count : buffers.removed_count) {
+        removed_total += count;
+    }
+    if (!removed_total) {
+        return buffers.remap;
+    }
+
+    // Holes are removed objects below the new size, movers are kept objects above it.
+    // There are as many holes as movers, each mover fills a hole so only the tail moves
+    const uint64_t new_size = old_size - removed_total;
+    for_each_block([&](uint32_t b, uint64_t first, uint64_t last) {
+        uint64_t holes = 0;
+        uint64_t movers = 0;
+        for (uint64_t i{first}; i < last; ++i) {
+            holes  += (i <  new_size) &&  removal_flags[i];
+            movers += (i >= new_size) && !removal_flags[i];
         }
+        buffers.holes_count[b]  = holes;
+        buffers.movers_count[b] = movers;
+    });
+    // Exclusive prefix sums give each block its write offsets
+    uint64_t holes_offset   = 0;
+    uint64_t movers_offset  = 0;
+    uint64_t removed_offset = 0;
+    for (uint32_t b{0}; b < block_count; ++b) {
+        const uint64_t holes   = buffers.holes_count[b];
+        const uint64_t movers  = buffers.movers_count[b];
+        const uint64_t removed = buffers.removed_count[b];
+        buffers.holes_count[b]   = holes_offset;
+        buffers.movers_count[b]  = movers_offset;
+        buffers.removed_count[b] = removed_offset;
+        holes_offset   += holes;
+        movers_offset  += movers;
+        removed_offset += removed;
     }
+    buffers.holes.resize(holes_offset);
+    buffers.movers.resize(movers_offset);
+    buffers.removed_ids.resize(removed_total);
+    buffers.remap.resize(old_size);
+    for_each_block([&](uint32_t b, uint64_t first, uint64_t last) {
+        uint64_t holes   = buffers.holes_count[b];
+        uint64_t movers  = buffers.movers_count[b];
+        uint64_t removed = buffers.removed_count[b];
+        for (uint64_t i{first}; i < last; ++i) {
+            if (removal_flags[i]) {
+                buffers.removed_ids[removed++] = metadata[i].rid;
+                buffers.remap[i] = InvalidIndex;
+                if (i < new_size) {
+                    buffers.holes[holes++] = i;
+                }
+            } else {
+                buffers.remap[i] = i;
+                if (i >= new_size) {
+                    buffers.movers[movers++] = i;
+                }
+            }
+        }
+    });
+
+    // Move the tail objects into the holes
+    const auto moves_count = static_cast<uint32_t>(buffers.holes.size());
+    dispatch(moves_count, [&](uint32_t start, uint32_t end) {
+        for (uint32_t k{start}; k < end; ++k) {
+            const uint64_t hole  = buffers.holes[k];
+            const uint64_t mover = buffers.movers[k];
+            data[hole]          = std::move(data[mover]);
+            metadata[hole]      = metadata[mover];
+            removal_flags[hole] = 0;
+            ids[metadata[hole].rid] = hole;
+            buffers.remap[mover]    = hole;
+        }
+    });
+
+    // The tail now holds free slots, destroy their content and make their IDs reusable
+    const uint64_t op_base = op_count;
+    dispatch(static_cast<uint32_t>(removed_total), [&](uint32_t start, uint32_t end) {
+        for (uint32_t k{start}; k < end; ++k) {
+            const uint64_t i  = new_size + k;
+            const ID       id = buffers.removed_ids[k];
+            data[i].~T();
+            metadata[i]      = {id, op_base + k + 1};
+            removal_flags[i] = 0;
+            ids[id]          = i;
+        }
+    });
+    op_count += removed_total;
+    data_size = new_size;
+    ++layout_version;
+    return buffers.remap;
 }
 
-template<typename T>
-ID Vector<T>::getNextID() const {
+template<typename T, template<typename> class TStorage>
+ID Vector<T, TStorage>::getNextID() const {
     return isFull() ? data_size : metadata[data_size].rid;
 }
 
-template<typename T>
-void *Vector<T>::get(civ::ID id)
+template<typename T, template<typename> class TStorage>
+void *Vector<T, TStorage>::get(civ::ID id)
 {
     return static_cast<void*>(&data[ids[id]]);
 }
 
-template<typename T>
-void Vector<T>::clear()
+template<typename T, template<typename> class TStorage>
+void Vector<T, TStorage>::clear()
 {
     ids.clear();
     data.clear();
     metadata.clear();
+    removal_flags.clear();
     for (SlotMetadata& slm : metadata) {
         slm.rid   = 0;
         slm.op_id = ++op_count;
     }
     data_size = 0;
+    ++layout_version;
 }
 
-template<typename T>
+template<typename T, template<typename> class TStorage>
 template<typename TCallback>
-void Vector<T>::foreach(TCallback &&callback) {
+void Vector<T, TStorage>::foreach(TCallback &&callback) {
     // Use index based for to allow data creation during iteration
     const uint64_t current_size = data_size;
     for (uint64_t i{0}; i<current_size; i++) {
@@ -378,13 +605,13 @@ void Vector<T>::foreach(TCallback &&callback) {
     }
 }
 
-template<typename T>
-ID Vector<T>::getValidityID(ID id) const
+template<typename T, template<typename> class TStorage>
+ID Vector<T, TStorage>::getValidityID(ID id) const
 {
     return metadata[ids[id]].op_id;
 }
 
-template<typename T>
+template<typename T, template<typename> class TStorage>
 struct Ref
 {
     Ref()
@@ -393,7 +620,7 @@ struct Ref
         , validity_id(0)
     {}
 
-    Ref(ID id_, Vector<T>* a, ID vid)
+    Ref(ID id_, Vector<T, TStorage>* a, ID vid)
         : id(id_)
         , array(a)
         , validity_id(vid)
@@ -431,9 +658,9 @@ struct Ref
     }
 
 public:
-    ID         id;
-    Vector<T>* array;
-    ID         validity_id;
+    ID                   id;
+    Vector<T, TStorage>* array;
+    ID                   validity_id;
 };
 
 
@@ -449,8 +676,8 @@ struct PRef
         , validity_id(0)
     {}
 
-    template<typename U>
-    PRef(ID index, Vector<U>* a, ID vid)
+    template<typename U, template<typename> class TStorage>
+    PRef(ID index, Vector<U, TStorage>* a, ID vid)
         : id(index)
         , provider_callback{PRef<T>::get<U>}
         , provider(a)
@@ -505,7 +732,7 @@ private:
     uint64_t            validity_id;
 
     template<class U> friend struct PRef;
-    template<class U> friend struct Vector;
+    template<class U, template<typename> class TStorage> friend struct Vector;
 };
 
 }
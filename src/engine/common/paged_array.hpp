@@ -0,0 +1,177 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+#include "arena.hpp"
+
+
+namespace civ
+{
+
+// Array made of fixed size pages, elements never move when it grows.
+// Growing only allocates new pages and appends their address to the page table,
+// the existing elements are neither copied nor relocated.
+// Pages come from the arena, accounted to TTag.
+template<typename T, uint32_t PageSizeLog = 14, mem::Tag TTag = mem::Tag::Objects>
+struct PagedArray
+{
+    static constexpr uint64_t page_size = uint64_t{1} << PageSizeLog;
+    static constexpr uint64_t page_mask = page_size - 1;
+
+    template<typename TValue, typename TArray>
+    struct Iterator
+    {
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = TValue*;
+        using reference         = TValue&;
+
+        TArray*  array = nullptr;
+        uint64_t index = 0;
+
+        reference operator*() const { return (*array)[index]; }
+        pointer   operator->() const { return &(*array)[index]; }
+        reference operator[](difference_type n) const { return (*array)[index + n]; }
+
+        Iterator& operator++() { ++index; return *this; }
+        Iterator& operator--() { --index; return *this; }
+        Iterator  operator++(int) { Iterator it = *this; ++index; return it; }
+        Iterator  operator--(int) { Iterator it = *this; --index; return it; }
+        Iterator& operator+=(difference_type n) { index += n; return *this; }
+        Iterator& operator-=(difference_type n) { index -= n; return *this; }
+        Iterator  operator+(difference_type n) const { return {array, index + n}; }
+        Iterator  operator-(difference_type n) const { return {array, index - n}; }
+        difference_type operator-(const Iterator& other) const { return static_cast<difference_type>(index - other.index); }
+
+        bool operator==(const Iterator& other) const { return index == other.index; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+        bool operator<(const Iterator& other) const { return index < other.index; }
+    };
+
+    using iterator       = Iterator<T, PagedArray>;
+    using const_iterator = Iterator<const T, const PagedArray>;
+
+    PagedArray() = default;
+
+    T& operator[](uint64_t i)
+    {
+        return pages[i >> PageSizeLog][i & page_mask];
+    }
+
+    const T& operator[](uint64_t i) const
+    {
+        return pages[i >> PageSizeLog][i & page_mask];
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        reserve(m_size + 1);
+        T& obj = (*this)[m_size++];
+        obj = T(std::forward<Args>(args)...);
+        return obj;
+    }
+
+    void push_back(const T& obj)
+    {
+        emplace_back(obj);
+    }
+
+    void resize(uint64_t size)
+    {
+        reserve(size);
+        for (uint64_t i{m_size}; i < size; ++i) {
+            (*this)[i] = T{};
+        }
+        m_size = size;
+    }
+
+    void reserve(uint64_t size)
+    {
+        while (getCapacity() < size) {
+            T* page = static_cast<T*>(mem::Arena::get().allocate(page_size * sizeof(T), TTag));
+            for (uint64_t i{0}; i < page_size; ++i) {
+                new(page + i) T;
+            }
+            pages.emplace_back(page);
+        }
+    }
+
+    // Keeps the pages allocated like std::vector keeps its capacity
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    [[nodiscard]]
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    [[nodiscard]]
+    uint64_t getCapacity() const
+    {
+        return pages.size() * page_size;
+    }
+
+    iterator       begin()       { return {this, 0}; }
+    iterator       end()         { return {this, m_size}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end()   const { return {this, m_size}; }
+
+    // Calls callback(first, count) for each contiguous run of elements in [start, end)
+    template<typename TCallback>
+    void foreachRun(uint64_t start, uint64_t end, TCallback&& callback)
+    {
+        while (start < end) {
+            const uint64_t run_end = std::min(end, (start | page_mask) + 1);
+            callback(&(*this)[start], run_end - start);
+            start = run_end;
+        }
+    }
+
+private:
+    struct PageDeleter
+    {
+        void operator()(T* page) const
+        {
+            for (uint64_t i{0}; i < page_size; ++i) {
+                page[i].~T();
+            }
+            mem::Arena::get().deallocate(page, page_size * sizeof(T), TTag);
+        }
+    };
+
+    std::vector<std::unique_ptr<T[], PageDeleter>> pages;
+    uint64_t                                       m_size = 0;
+};
+
+
+// Storage modes of civ::Vector
+template<typename T>
+using ContiguousStorage = mem::Vector<T, mem::Tag::Objects>;
+
+template<typename T>
+using PagedStorage = PagedArray<T>;
+
+
+template<typename T, typename TAllocator, typename TCallback>
+void foreachRun(std::vector<T, TAllocator>& storage, uint64_t start, uint64_t end, TCallback&& callback)
+{
+    if (start < end) {
+        callback(storage.data() + start, end - start);
+    }
+}
+
+template<typename T, uint32_t PageSizeLog, mem::Tag TTag, typename TCallback>
+void foreachRun(PagedArray<T, PageSizeLog, TTag>& storage, uint64_t start, uint64_t end, TCallback&& callback)
+{
+    storage.foreachRun(start, end, std::forward<TCallback>(callback));
+}
+
+}
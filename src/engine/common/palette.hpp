@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <initializer_list>
+#include <SFML/Graphics/Color.hpp>
+#include "color_utils.hpp"
+
+
+// Objects store an index in a palette instead of a color
+using ColorIndex = uint16_t;
+
+
+// Precomputed gradient, objects colors are only expanded when rendering
+struct Palette
+{
+    static constexpr uint32_t default_size = 1024;
+
+    std::vector<sf::Color> colors;
+
+    Palette() = default;
+
+    explicit
+    Palette(std::vector<sf::Color> colors_)
+        : colors{std::move(colors_)}
+    {}
+
+    [[nodiscard]]
+    sf::Color operator[](ColorIndex index) const
+    {
+        return colors[index % colors.size()];
+    }
+
+    [[nodiscard]]
+    uint32_t size() const
+    {
+        return to<uint32_t>(colors.size());
+    }
+
+    // Samples gradient(t) for t in [0, 1)
+    template<typename TGradient>
+    static Palette sample(uint32_t size, TGradient&& gradient)
+    {
+        std::vector<sf::Color> colors(size);
+        for (uint32_t i{0}; i < size; ++i) {
+            colors[i] = gradient(to<float>(i) / to<float>(size));
+        }
+        return Palette{std::move(colors)};
+    }
+
+    // One period of ColorUtils::getRainbow
+    static Palette createRainbow(uint32_t size = default_size)
+    {
+        return sample(size, [](float t) { return ColorUtils::getRainbow(t * Math::PI); });
+    }
+
+    // Linear interpolation between evenly spaced keys, looping back to the first one
+    static Palette createGradient(std::initializer_list<sf::Color> keys, uint32_t size = default_size)
+    {
+        const std::vector<sf::Color> k{keys};
+        return sample(size, [&k](float t) {
+            const float    position = t * to<float>(k.size());
+            const auto     key      = to<uint32_t>(position);
+            const uint32_t next     = (key + 1) % to<uint32_t>(k.size());
+            return ColorUtils::interpolate(k[key], k[next], position - to<float>(key));
+        });
+    }
+};
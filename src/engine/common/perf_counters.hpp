@@ -0,0 +1,348 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include "thread_pool/thread_pool.hpp"
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+
+// Hardware performance counters read with perf_event_open. Each thread opens its own counters and only
+// counts its own work, user space only. Events the kernel or the CPU do not provide (VMs, containers,
+// perf_event_paranoid) are reported as unavailable and the other ones are still counted.
+namespace perf
+{
+
+enum class Event : uint8_t
+{
+    // CPU time of the thread in ns, software event available almost everywhere
+    TaskClock,
+    Cycles,
+    Instructions,
+    // Last level cache misses
+    CacheMisses,
+    BranchMisses,
+    Count
+};
+
+constexpr uint32_t events_count = static_cast<uint32_t>(Event::Count);
+
+inline const char* getEventName(Event event)
+{
+    constexpr const char* names[events_count] = {"task_clock_ns", "cycles", "instructions", "llc_misses", "branch_misses"};
+    return names[static_cast<uint32_t>(event)];
+}
+
+struct Counters
+{
+    std::array<uint64_t, events_count> values = {};
+
+    uint64_t operator[](Event event) const
+    {
+        return values[static_cast<uint32_t>(event)];
+    }
+
+    Counters& operator+=(const Counters& other)
+    {
+        for (uint32_t i{0}; i < events_count; ++i) {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+
+    Counters operator-(const Counters& other) const
+    {
+        Counters result;
+        for (uint32_t i{0}; i < events_count; ++i) {
+            result.values[i] = values[i] - other.values[i];
+        }
+        return result;
+    }
+};
+
+
+// Counters of the calling thread, all events are read at once as a group led by the task clock
+class ThreadCounters
+{
+public:
+    ThreadCounters()
+    {
+#if defined(__linux__)
+        constexpr std::array<std::pair<uint32_t, uint64_t>, events_count> configs = {{
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        }};
+        for (uint32_t i{0}; i < events_count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = configs[i].first;
+            attr.config         = configs[i].second;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP;
+            const auto fd = static_cast<int32_t>(syscall(__NR_perf_event_open, &attr, 0, -1, m_group_fd, 0));
+            if (fd < 0) {
+                if (m_group_fd < 0) {
+                    // Without the leader nothing can be counted
+                    return;
+                }
+                continue;
+            }
+            if (m_group_fd < 0) {
+                m_group_fd = fd;
+            }
+            m_fds[m_opened_count]    = fd;
+            m_events[m_opened_count] = i;
+            ++m_opened_count;
+        }
+#endif
+    }
+
+    ~ThreadCounters()
+    {
+#if defined(__linux__)
+        for (uint32_t i{0}; i < m_opened_count; ++i) {
+            close(m_fds[i]);
+        }
+#endif
+    }
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    [[nodiscard]]
+    bool isAvailable(Event event) const
+    {
+        for (uint32_t i{0}; i < m_opened_count; ++i) {
+            if (m_events[i] == static_cast<uint32_t>(event)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Values since the counters were opened, unavailable events stay at 0
+    [[nodiscard]]
+    Counters read() const
+    {
+        Counters counters;
+#if defined(__linux__)
+        if (m_opened_count) {
+            // Group format: number of events then their values in opening order
+            std::array<uint64_t, events_count + 1> buffer = {};
+            if (::read(m_group_fd, buffer.data(), sizeof(buffer)) > 0) {
+                for (uint32_t i{0}; i < m_opened_count && i < buffer[0]; ++i) {
+                    counters.values[m_events[i]] = buffer[i + 1];
+                }
+            }
+        }
+#endif
+        return counters;
+    }
+
+    // Counters of the calling thread, opened on first use
+    static ThreadCounters& get()
+    {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+private:
+    int32_t                            m_group_fd     = -1;
+    std::array<int32_t, events_count>  m_fds          = {};
+    std::array<uint32_t, events_count> m_events       = {};
+    uint32_t                           m_opened_count = 0;
+};
+
+
+// Counters of a thread pool's work split by phase and by thread. The thread pool's workers report the
+// counters of each task to the current phase, the calling thread is measured over whole phases
+// (including its wait for the workers) and is the last thread of each phase.
+class PhaseProfiler : public tp::TaskObserver
+{
+public:
+    PhaseProfiler(std::vector<std::string> phase_names, uint32_t workers_count)
+        : m_phase_names{std::move(phase_names)}
+        , m_threads_count{workers_count + 1}
+        , m_counters(m_phase_names.size() * m_threads_count)
+        , m_tasks(m_phase_names.size() * m_threads_count, 0)
+        , m_time_ms(m_phase_names.size(), 0.0)
+        , m_task_start(workers_count)
+    {
+        const ThreadCounters& counters = ThreadCounters::get();
+        for (uint32_t i{0}; i < events_count; ++i) {
+            m_available[i] = counters.isAvailable(static_cast<Event>(i));
+        }
+    }
+
+    void beginPhase(uint32_t phase)
+    {
+        m_phase.store(phase, std::memory_order_relaxed);
+        m_phase_start = ThreadCounters::get().read();
+        m_phase_clock = std::chrono::steady_clock::now();
+    }
+
+    void endPhase(uint32_t phase)
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - m_phase_clock;
+        m_time_ms[phase] += std::chrono::duration<double, std::milli>(elapsed).count();
+        m_counters[phase * m_threads_count + m_threads_count - 1] += ThreadCounters::get().read() - m_phase_start;
+    }
+
+    void onTaskStart(uint32_t worker_id) override
+    {
+        m_task_start[worker_id].counters = ThreadCounters::get().read();
+    }
+
+    void onTaskEnd(uint32_t worker_id) override
+    {
+        const uint32_t phase = m_phase.load(std::memory_order_relaxed);
+        m_counters[phase * m_threads_count + worker_id] += ThreadCounters::get().read() - m_task_start[worker_id].counters;
+        ++m_tasks[phase * m_threads_count + worker_id];
+    }
+
+    void reset()
+    {
+        std::fill(m_counters.begin(), m_counters.end(), Counters{});
+        std::fill(m_tasks.begin(), m_tasks.end(), 0);
+        std::fill(m_time_ms.begin(), m_time_ms.end(), 0.0);
+    }
+
+    [[nodiscard]]
+    bool isAvailable(Event event) const
+    {
+        return m_available[static_cast<uint32_t>(event)];
+    }
+
+    [[nodiscard]]
+    uint32_t getPhasesCount() const
+    {
+        return static_cast<uint32_t>(m_phase_names.size());
+    }
+
+    [[nodiscard]]
+    uint32_t getThreadsCount() const
+    {
+        return m_threads_count;
+    }
+
+    [[nodiscard]]
+    const std::string& getPhaseName(uint32_t phase) const
+    {
+        return m_phase_names[phase];
+    }
+
+    [[nodiscard]]
+    double getTimeMs(uint32_t phase) const
+    {
+        return m_time_ms[phase];
+    }
+
+    // Thread m_threads_count - 1 is the calling thread
+    [[nodiscard]]
+    const Counters& getCounters(uint32_t phase, uint32_t thread) const
+    {
+        return m_counters[phase * m_threads_count + thread];
+    }
+
+    [[nodiscard]]
+    uint64_t getTasksCount(uint32_t phase, uint32_t thread) const
+    {
+        return m_tasks[phase * m_threads_count + thread];
+    }
+
+    [[nodiscard]]
+    Counters getPhaseTotal(uint32_t phase) const
+    {
+        Counters total;
+        for (uint32_t thread{0}; thread < m_threads_count; ++thread) {
+            total += getCounters(phase, thread);
+        }
+        return total;
+    }
+
+    // One line per phase and per thread, unavailable events are left empty
+    void writeCSV(std::ostream& out) const
+    {
+        out << "phase,thread,time_ms,tasks";
+        for (uint32_t i{0}; i < events_count; ++i) {
+            out << ',' << getEventName(static_cast<Event>(i));
+        }
+        out << '\n';
+        for (uint32_t phase{0}; phase < getPhasesCount(); ++phase) {
+            for (uint32_t thread{0}; thread < m_threads_count; ++thread) {
+                const bool caller = thread == m_threads_count - 1;
+                out << m_phase_names[phase] << ',' << (caller ? std::string{"caller"} : std::to_string(thread)) << ','
+                    << (caller ? m_time_ms[phase] : 0.0) << ',' << getTasksCount(phase, thread);
+                for (uint32_t i{0}; i < events_count; ++i) {
+                    out << ',';
+                    if (m_available[i]) {
+                        out << getCounters(phase, thread).values[i];
+                    }
+                }
+                out << '\n';
+            }
+        }
+    }
+
+private:
+    // Written by a single worker, padded to avoid false sharing
+    struct alignas(64) TaskStart
+    {
+        Counters counters;
+    };
+
+    std::vector<std::string>              m_phase_names;
+    uint32_t                              m_threads_count;
+    std::vector<Counters>                 m_counters;
+    std::vector<uint64_t>                 m_tasks;
+    std::vector<double>                   m_time_ms;
+    std::vector<TaskStart>                m_task_start;
+    std::array<bool, events_count>        m_available = {};
+    std::atomic<uint32_t>                 m_phase     = 0;
+    Counters                              m_phase_start;
+    std::chrono::steady_clock::time_point m_phase_clock;
+};
+
+
+// Measures a phase for the lifetime of the scope, does nothing without profiler
+class PhaseScope
+{
+public:
+    PhaseScope(PhaseProfiler* profiler, uint32_t phase)
+        : m_profiler{profiler}
+        , m_phase{phase}
+    {
+        if (m_profiler) {
+            m_profiler->beginPhase(m_phase);
+        }
+    }
+
+    ~PhaseScope()
+    {
+        if (m_profiler) {
+            m_profiler->endPhase(m_phase);
+        }
+    }
+
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+
+private:
+    PhaseProfiler* m_profiler;
+    uint32_t       m_phase;
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <mutex>
+#include <cstdint>
+#include <utility>
+
+
+// Lets a producer thread publish values while a consumer thread reads the latest published one.
+// The producer never waits for the consumer: publishing again before the consumer read the
+// previous value replaces it, which is reported as a dropped value.
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    // Producer side, the returned buffer still holds the value written three publications ago
+    T& getWriteBuffer()
+    {
+        return m_buffers[m_write];
+    }
+
+    // Makes the write buffer the latest value, returns true if the previous one was never read
+    bool publish()
+    {
+        std::lock_guard<std::mutex> lock_guard{m_mutex};
+        std::swap(m_write, m_ready);
+        const bool dropped = m_fresh;
+        m_fresh = true;
+        ++m_published_count;
+        m_dropped_count += dropped;
+        return dropped;
+    }
+
+    // Consumer side, returns the latest published value or nullptr if nothing was published yet.
+    // is_new is false when the value was already returned by a previous call
+    T* getLatest(bool& is_new)
+    {
+        std::lock_guard<std::mutex> lock_guard{m_mutex};
+        is_new = m_fresh;
+        if (m_fresh) {
+            std::swap(m_read, m_ready);
+            m_fresh = false;
+            m_has_value = true;
+        }
+        return m_has_value ? &m_buffers[m_read] : nullptr;
+    }
+
+    [[nodiscard]]
+    uint64_t getPublishedCount() const
+    {
+        std::lock_guard<std::mutex> lock_guard{m_mutex};
+        return m_published_count;
+    }
+
+    [[nodiscard]]
+    uint64_t getDroppedCount() const
+    {
+        std::lock_guard<std::mutex> lock_guard{m_mutex};
+        return m_dropped_count;
+    }
+
+private:
+    T                  m_buffers[3];
+    uint32_t           m_write           = 0;
+    uint32_t           m_ready           = 1;
+    uint32_t           m_read            = 2;
+    bool               m_fresh           = false;
+    bool               m_has_value       = false;
+    uint64_t           m_published_count = 0;
+    uint64_t           m_dropped_count   = 0;
+    mutable std::mutex m_mutex;
+};
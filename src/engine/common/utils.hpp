@@ -1,4 +1,5 @@
 #pragma once
+#include <SFML/System/Vector2.hpp>
 #include "index_vector.hpp"
 #include <sstream>
 
@@ -13,6 +14,9 @@ U to(const T& v)
 template<typename T>
 using CIVector = civ::Vector<T>;
 
+template<typename T>
+using PagedCIVector = civ::Vector<T, civ::PagedStorage>;
+
 
 template<typename T>
 T sign(T v)
@@ -118,4 +118,17 @@ struct ViewportHandler
     {
         return state.transform.transformPoint(world_pos);
     }
+
+    // Pixels per world unit
+    float getZoom() const
+    {
+        return state.zoom;
+    }
+
+    // World area covered by the render target
+    sf::FloatRect getVisibleRect() const
+    {
+        const sf::Vector2f half_size = state.center / state.zoom;
+        return {state.offset - half_size, 2.0f * half_size};
+    }
 };
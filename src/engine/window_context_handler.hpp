@@ -28,6 +28,18 @@ public:
         m_viewport_handler.setZoom(zoom);
     }
     
+    [[nodiscard]]
+    float getZoom() const
+    {
+        return m_viewport_handler.getZoom();
+    }
+
+    [[nodiscard]]
+    sf::FloatRect getVisibleRect() const
+    {
+        return m_viewport_handler.getVisibleRect();
+    }
+
     void registerCallbacks(sfev::EventManager& event_manager)
     {
         event_manager.addEventCallback(sf::Event::Closed, [&](sfev::CstEv) { m_window.close(); });
@@ -57,6 +69,18 @@ public:
         m_window.draw(drawable, render_states);
     }
     
+    void draw(const sf::VertexBuffer& vertex_buffer, std::size_t first, std::size_t count, sf::RenderStates render_states = {})
+    {
+        render_states.transform = m_viewport_handler.getTransform();
+        m_window.draw(vertex_buffer, first, count, render_states);
+    }
+
+    void draw(const sf::Vertex* vertices, std::size_t count, sf::PrimitiveType type, sf::RenderStates render_states = {})
+    {
+        render_states.transform = m_viewport_handler.getTransform();
+        m_window.draw(vertices, count, type, render_states);
+    }
+    
     void clear(sf::Color color = sf::Color::Black)
     {
         m_window.clear(color);
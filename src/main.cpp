@@ -1,31 +1,152 @@
 #include <iostream>
 #include <queue>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <atomic>
+#include <chrono>
+#include <memory>
 
 #include "engine/window_context_handler.hpp"
 #include "engine/common/color_utils.hpp"
 
 #include "physics/physics.hpp"
+#include "physics/emitter.hpp"
 #include "thread_pool/thread_pool.hpp"
 #include "renderer/renderer.hpp"
+#include "renderer/render_pipeline.hpp"
+#include "renderer/software_renderer.hpp"
+#include "renderer/frame_writer.hpp"
 
 
-int main()
+struct RunOptions
 {
-    const uint32_t window_width  = 1920;
-    const uint32_t window_height = 1200;
-    WindowContextHandler app("Verlet-MultiThread", sf::Vector2u(window_width, window_height), sf::Style::Default);
-    RenderContext& render_context = app.getRenderContext();
-    // Initialize solver and renderer
+    // No window, the solver is stepped as fast as possible
+    bool     headless        = false;
+    // Removes the framerate limit and the simulation pacing
+    bool     fast            = false;
+    // Simulates, prepares and draws each frame on the window thread instead of pipelining them
+    bool     serial_render   = false;
+    // Freezes the settled regions of the world, approximate so it is off by default
+    bool     sleep           = false;
+    uint32_t steps_per_frame = 1;
+    // Only one frame out of render_every is rendered
+    uint32_t render_every    = 1;
+    // Number of frames to simulate before exiting, 0 to run until the window is closed
+    uint32_t frames          = 0;
+    // Frames export, rendered on the CPU so it also works in headless mode
+    bool                export_frames = false;
+    FrameWriter::Format export_format = FrameWriter::Format::PPM;
+    std::string         export_target;
+    uint32_t            export_width  = 1920;
+    uint32_t            export_height = 1080;
+};
+
+
+void printUsage()
+{
+    std::cout << "Usage: VerletMulti [options]\n"
+              << "Options:\n"
+              << "  --headless            Runs without window as fast as possible (default 3600 frames)\n"
+              << "  --fast                Does not limit the simulation to real time\n"
+              << "  --serial-render       Simulates and renders on the same thread\n"
+              << "  --sleep               Freezes the settled regions, faster but approximate\n"
+              << "  --steps-per-frame N   Solver steps per frame\n"
+              << "  --render-every K      Renders one frame out of K\n"
+              << "  --frames N            Exits after N frames\n"
+              << "  --ppm DIR             Exports rendered frames as PPM images\n"
+              << "  --png DIR             Exports rendered frames as PNG images\n"
+              << "  --pipe CMD            Pipes rendered frames as raw RGBA to CMD\n"
+              << "  --export-width N      Width of the exported frames\n"
+              << "  --export-height N     Height of the exported frames" << std::endl;
+}
+
+// Strict unsigned parsing, negative values, values above the uint32_t limit and trailing characters are rejected
+bool parseUint32(const std::string& str, uint32_t& value)
+{
+    // stoull skips leading spaces and wraps negative values, the value has to start with a digit
+    if (str.empty() || str[0] < '0' || str[0] > '9') {
+        return false;
+    }
+    try {
+        size_t pos = 0;
+        const unsigned long long parsed = std::stoull(str, &pos);
+        if (pos != str.size() || parsed > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        value = static_cast<uint32_t>(parsed);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char** argv, RunOptions& options)
+{
+    for (int32_t i{1}; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+            continue;
+        } else if (arg == "--fast") {
+            options.fast = true;
+            continue;
+        } else if (arg == "--serial-render") {
+            options.serial_render = true;
+            continue;
+        } else if (arg == "--sleep") {
+            options.sleep = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const std::string value_str = argv[++i];
+        if (arg == "--ppm" || arg == "--png" || arg == "--pipe") {
+            options.export_frames = true;
+            options.export_target = value_str;
+            options.export_format = arg == "--ppm" ? FrameWriter::Format::PPM : (arg == "--png" ? FrameWriter::Format::PNG : FrameWriter::Format::Pipe);
+            continue;
+        }
+        // Malformed values print the usage instead of throwing
+        uint32_t value = 0;
+        if (!parseUint32(value_str, value)) {
+            return false;
+        }
+        if (arg == "--steps-per-frame") {
+            options.steps_per_frame = std::max(1u, value);
+        } else if (arg == "--render-every") {
+            options.render_every = std::max(1u, value);
+        } else if (arg == "--frames") {
+            options.frames = value;
+        } else if (arg == "--export-width") {
+            options.export_width = std::max(1u, value);
+        } else if (arg == "--export-height") {
+            options.export_height = std::max(1u, value);
+        } else {
+            return false;
+        }
+    }
+    if (options.headless && !options.frames) {
+        options.frames = 3600;
+    }
+    return true;
+}
 
+
+int main(int argc, char** argv)
+{
+    RunOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    // Initialize solver
     tp::ThreadPool thread_pool(10);
     const IVec2 world_size{600, 600};
     PhysicSolver solver{world_size, thread_pool};
-    Renderer renderer(solver, thread_pool);
-
-    const float margin = 20.0f;
-    const auto  zoom   = static_cast<float>(window_height - margin) / static_cast<float>(world_size.y);
-    render_context.setZoom(zoom);
-    render_context.setFocus({world_size.x * 0.5f, world_size.y * 0.5f});
+    solver.setSleepEnabled(options.sleep);
 
     bool emit = true;
     constexpr float fps_sim = 60;
@@ -34,29 +155,46 @@ int main()
     constexpr int objects_per_iteration = 250;
     int fps_count = 0;
 
+    Emitter emitter;
+    emitter.position         = {2.0f, 10.0f};
+    emitter.spacing          = {0.0f, 1.1f};
+    emitter.velocity         = {0.2f, 0.0f};
+    emitter.objects_per_step = objects_per_iteration;
+    emitter.max_objects      = 300000;
+
+    // The software renderer allocates its frame buffer, it is only created when frames are exported
+    std::unique_ptr<SoftwareRenderer> software_renderer;
+    FrameWriter                       frame_writer;
+    if (options.export_frames) {
+        if (!frame_writer.open(options.export_format, options.export_target, options.export_width, options.export_height)) {
+            std::cout << "Cannot open " << options.export_target << std::endl;
+            return 1;
+        }
+        software_renderer = std::make_unique<SoftwareRenderer>(solver, thread_pool, options.export_width, options.export_height);
+    }
+
     // Main loop
     sf::Clock clock;
     float lastTime = clock.getElapsedTime().asSeconds();
     float currentTime, fps;
     const float dt = 1.0f / static_cast<float>(fps_sim);
-    while (app.run()) {
-        if (solver.objects.size() < 300000 && emit) {
-            for (uint32_t i{objects_per_iteration}; i--;) {
-                const auto id = solver.createObject({2.0f, 10.0f + 1.1f * i});
-                solver.objects[id].last_position.x -= 0.2f;
-                solver.objects[id].color = ColorUtils::getRainbow(id * 0.0001f);
-            }
+    // Only the default mode prints the FPS of each frame
+    const bool print_fps = !options.headless && !options.fast && options.steps_per_frame == 1;
+    uint32_t frame_count = 0;
+    std::atomic<bool> finished = false;
+    const auto simulation_frame = [&]() {
+        if (finished) {
+            return;
+        }
+        for (uint32_t i{options.steps_per_frame}; i--;) {
+            emitter.active = emit;
+            emitter.update(solver);
+            solver.update(dt);
         }
-
-        solver.update(dt);
         currentTime = clock.getElapsedTime().asSeconds();
         fps = 1.f / (currentTime - lastTime);
 
-        render_context.clear();
-        renderer.render(render_context);
-        render_context.display();
-
-        if (emit) {
+        if (emit && print_fps) {
             std::cout << "FPS: " << fps << std::endl;
         }
         if(fps < fps_cap && emit){
@@ -70,7 +208,84 @@ int main()
             fps_count = 0;
         }
         lastTime = currentTime;
+
+        ++frame_count;
+        if (options.export_frames && frame_count % options.render_every == 0) {
+            software_renderer->render();
+            if (!frame_writer.write(software_renderer->getPixels())) {
+                // The disk is full or the encoder exited, the simulation goes on without export
+                std::cout << "Cannot write frame " << frame_count << " to " << options.export_target << ", export stopped" << std::endl;
+                options.export_frames = false;
+                frame_writer.close();
+            }
+        }
+        if (options.frames && frame_count >= options.frames) {
+            finished = true;
+        }
+    };
+
+    const auto printSummary = [&](float wall_time) {
+        const float simulated_time = static_cast<float>(frame_count * options.steps_per_frame) * dt;
+        std::cout << "Simulated " << simulated_time << " s in " << wall_time << " s (x" << simulated_time / wall_time
+                  << ") with " << solver.objects.size() << " objects" << std::endl;
+    };
+
+    if (options.headless) {
+        const auto start = std::chrono::steady_clock::now();
+        while (!finished) {
+            simulation_frame();
+        }
+        printSummary(std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
+        return 0;
+    }
+
+    const uint32_t window_width  = 1920;
+    const uint32_t window_height = 1200;
+    WindowContextHandler app("Verlet-MultiThread", sf::Vector2u(window_width, window_height), sf::Style::Default);
+    RenderContext& render_context = app.getRenderContext();
+    Renderer renderer(solver, thread_pool);
+
+    const float margin = 20.0f;
+    const auto  zoom   = static_cast<float>(window_height - margin) / static_cast<float>(world_size.y);
+    render_context.setZoom(zoom);
+    render_context.setFocus({world_size.x * 0.5f, world_size.y * 0.5f});
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!options.serial_render) {
+        // Simulation and rendering run on separate threads, frames are drawn while the next step is simulated
+        // The window keeps its framerate limit, drawing faster than the display would only repeat frames
+        RenderPipeline pipeline{renderer, simulation_frame, options.fast ? 0.0f : fps_sim};
+        pipeline.setFrameInterval(options.render_every);
+        pipeline.setView(Renderer::getView(render_context));
+        pipeline.start();
+        while (app.run() && !finished) {
+            pipeline.setView(Renderer::getView(render_context));
+            render_context.clear();
+            pipeline.draw(render_context);
+            render_context.display();
+        }
+        pipeline.stop();
+
+        const PipelineStats stats = pipeline.getStats();
+        std::cout << "Steps: " << stats.steps << " Frames drawn: " << stats.frames_drawn
+                  << " dropped: " << stats.frames_dropped << " repeated: " << stats.frames_repeated << std::endl;
+        std::cout << "Latency mean: " << stats.mean_latency_ms << " ms max: " << stats.max_latency_ms << " ms" << std::endl;
+    } else {
+        // The simulation is paced by the framerate limit of the window
+        if (options.fast) {
+            app.setFramerateLimit(0);
+        }
+        while (app.run() && !finished) {
+            simulation_frame();
+
+            if (frame_count % options.render_every == 0) {
+                render_context.clear();
+                renderer.render(render_context);
+                render_context.display();
+            }
+        }
     }
+    printSummary(std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
 
     return 0;
 }
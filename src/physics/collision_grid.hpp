@@ -4,21 +4,25 @@
 #include "engine/common/grid.hpp"
 
 
-struct CollisionCell
+template<uint8_t TCapacity>
+struct BasicCollisionCell
 {
-    static constexpr uint8_t cell_capacity = 4;
+    static constexpr uint8_t cell_capacity = TCapacity;
     static constexpr uint8_t max_cell_idx  = cell_capacity - 1;
 
     // Overlap workaround
 	uint32_t objects_count              = 0;
     uint32_t objects[cell_capacity] = {};
 
-	CollisionCell() = default;
+	BasicCollisionCell() = default;
 
-	void addAtom(uint32_t id)
+	// Returns false if the cell was full, the object is then dropped
+	bool addAtom(uint32_t id)
 	{
         objects[objects_count] = id;
-        objects_count += objects_count < max_cell_idx;
+        const bool added = objects_count < max_cell_idx;
+        objects_count += added;
+        return added;
 	}
 
 	void clear()
@@ -41,28 +45,37 @@ struct CollisionCell
     }
 };
 
-struct CollisionGrid : public Grid<CollisionCell>
+// Broadphase of the solver, TCapacity is the number of objects a cell can hold.
+// The collision pass walks the cells in the memory order of TLayout, see grid.hpp
+template<uint8_t TCapacity, typename TLayout = ColumnMajorLayout>
+struct BasicCollisionGrid : public Grid<BasicCollisionCell<TCapacity>, TLayout>
 {
-	CollisionGrid()
-		: Grid<CollisionCell>()
+    using Cell = BasicCollisionCell<TCapacity>;
+
+	BasicCollisionGrid()
+		: Grid<Cell, TLayout>()
 	{}
 
-	CollisionGrid(int32_t width, int32_t height)
-		: Grid<CollisionCell>(width, height)
+	BasicCollisionGrid(int32_t width, int32_t height)
+		: Grid<Cell, TLayout>(width, height)
 	{}
 
-	bool addAtom(uint32_t x, uint32_t y, uint32_t atom)
+	bool addAtom(int32_t x, int32_t y, uint32_t atom)
 	{
-		const uint32_t id = x * height + y;
+		const uint32_t id = this->getIndex(x, y);
 		// Add to grid
-		data[id].addAtom(atom);
-		return true;
+		return this->data[id].addAtom(atom);
 	}
 
 	void clear()
 	{
-		for (auto& c : data) {
+		for (auto& c : this->data) {
             c.objects_count = 0;
         }
 	}
 };
+
+using CollisionCell = BasicCollisionCell<4>;
+using CollisionGrid = BasicCollisionGrid<4>;
+// Cells stored in 8x8 tiles, the neighbors of a cell stay close in memory whatever the world's height
+using TiledCollisionGrid = BasicCollisionGrid<4, TiledLayout<>>;
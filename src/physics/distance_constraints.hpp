@@ -0,0 +1,231 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "physic_object.hpp"
+#include "quantized_object.hpp"
+#include "sized_object.hpp"
+#include "engine/common/index_vector.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+inline float getInverseMass(const PhysicObject&)
+{
+    return 1.0f;
+}
+
+inline float getInverseMass(const QuantizedObject&)
+{
+    return 1.0f;
+}
+
+inline float getInverseMass(const SizedObject& object)
+{
+    return object.inverse_mass;
+}
+
+
+// Links keeping two objects at a given distance (ropes, cloth, soft bodies), solved once per sub step.
+// Links are colored so that two links of the same color never share an object, each color is then
+// solved in parallel without synchronization. Coloring is done again only when links are added or removed.
+// Objects are referenced by data index, the solver keeps them valid when it compacts its objects.
+// Pinned objects can be kept in place with a fused::afterIntegration kernel.
+struct DistanceConstraints
+{
+    // Links that cannot get one of these colors are solved on the calling thread
+    static constexpr uint32_t max_colors = 64;
+
+    // One entry per link, sorted by color once colored
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> second;
+    std::vector<float>    length;
+    // 1 for rigid links, lower values give springy links
+    std::vector<float>    stiffness;
+    // Links of color c are in [color_offsets[c], color_offsets[c + 1]), the last range holds the uncolored links
+    std::vector<uint32_t> color_offsets;
+    // Set when the links changed since the last coloring
+    bool                  dirty = false;
+    // Filled by solve when it gets a motion threshold, 1 for the links that moved one of their objects further
+    std::vector<uint8_t>  moving;
+
+    void add(uint32_t object_1, uint32_t object_2, float link_length, float link_stiffness = 1.0f)
+    {
+        first.push_back(object_1);
+        second.push_back(object_2);
+        length.push_back(link_length);
+        stiffness.push_back(link_stiffness);
+        dirty = true;
+    }
+
+    // Links indices change when they are colored
+    void remove(uint32_t link_index)
+    {
+        const uint32_t last = size() - 1;
+        first[link_index]     = first[last];
+        second[link_index]    = second[last];
+        length[link_index]    = length[last];
+        stiffness[link_index] = stiffness[last];
+        first.pop_back();
+        second.pop_back();
+        length.pop_back();
+        stiffness.pop_back();
+        dirty = true;
+    }
+
+    void clear()
+    {
+        first.clear();
+        second.clear();
+        length.clear();
+        stiffness.clear();
+        color_offsets.clear();
+        dirty = false;
+    }
+
+    [[nodiscard]]
+    uint32_t size() const
+    {
+        return to<uint32_t>(first.size());
+    }
+
+    [[nodiscard]]
+    uint32_t getColorsCount() const
+    {
+        return color_offsets.empty() ? 0 : to<uint32_t>(color_offsets.size()) - 2;
+    }
+
+    // Follows a compaction of the objects, see civ::Vector::compact. Links to removed objects are removed,
+    // the others only change of data indices so their colors stay valid
+    void remap(const std::vector<uint64_t>& remap)
+    {
+        if (remap.empty()) {
+            return;
+        }
+        uint32_t i{0};
+        while (i < size()) {
+            const uint64_t object_1 = remap[first[i]];
+            const uint64_t object_2 = remap[second[i]];
+            if (object_1 == civ::InvalidIndex || object_2 == civ::InvalidIndex) {
+                remove(i);
+                continue;
+            }
+            first[i]  = to<uint32_t>(object_1);
+            second[i] = to<uint32_t>(object_2);
+            ++i;
+        }
+    }
+
+    // Follows the erase of a single object, the object at moved_index took its data index (see civ::Vector::erase).
+    // Links to the erased object are removed
+    void eraseObject(uint32_t erased_index, uint32_t moved_index)
+    {
+        uint32_t i{0};
+        while (i < size()) {
+            if (first[i] == erased_index || second[i] == erased_index) {
+                remove(i);
+                continue;
+            }
+            first[i]  = first[i]  == moved_index ? erased_index : first[i];
+            second[i] = second[i] == moved_index ? erased_index : second[i];
+            ++i;
+        }
+    }
+
+    // Greedy coloring, each link gets the first color used by none of the links of its objects
+    void color(uint64_t objects_count)
+    {
+        const uint32_t links_count = size();
+        std::vector<uint64_t> used_colors(objects_count, 0);
+        std::vector<uint8_t>  link_colors(links_count);
+        std::vector<uint32_t> counts(max_colors + 1, 0);
+        for (uint32_t i{0}; i < links_count; ++i) {
+            uint64_t& used_1 = used_colors[first[i]];
+            uint64_t& used_2 = used_colors[second[i]];
+            const uint64_t used = used_1 | used_2;
+            uint32_t c{0};
+            while (c < max_colors && ((used >> c) & 1)) {
+                ++c;
+            }
+            if (c < max_colors) {
+                used_1 |= uint64_t{1} << c;
+                used_2 |= uint64_t{1} << c;
+            }
+            link_colors[i] = to<uint8_t>(c);
+            ++counts[c];
+        }
+        // Only keep the used colors, the uncolored links stay last
+        uint32_t colors_count{0};
+        while (colors_count < max_colors && counts[colors_count]) {
+            ++colors_count;
+        }
+        color_offsets.assign(colors_count + 2, 0);
+        for (uint32_t c{0}; c < colors_count; ++c) {
+            color_offsets[c + 1] = color_offsets[c] + counts[c];
+        }
+        color_offsets[colors_count + 1] = links_count;
+        // Sort the links by color
+        std::vector<uint32_t> insert(color_offsets.begin(), color_offsets.end() - 1);
+        std::vector<uint32_t> sorted_first(links_count);
+        std::vector<uint32_t> sorted_second(links_count);
+        std::vector<float>    sorted_length(links_count);
+        std::vector<float>    sorted_stiffness(links_count);
+        for (uint32_t i{0}; i < links_count; ++i) {
+            const uint32_t c      = std::min<uint32_t>(link_colors[i], colors_count);
+            const uint32_t target = insert[c]++;
+            sorted_first[target]     = first[i];
+            sorted_second[target]    = second[i];
+            sorted_length[target]    = length[i];
+            sorted_stiffness[target] = stiffness[i];
+        }
+        first.swap(sorted_first);
+        second.swap(sorted_second);
+        length.swap(sorted_length);
+        stiffness.swap(sorted_stiffness);
+        dirty = false;
+    }
+
+    // Links moving an object further than motion_threshold are flagged in moving, if the threshold is positive
+    template<typename TObjects>
+    void solve(tp::ThreadPool& thread_pool, TObjects& objects, float motion_threshold = 0.0f)
+    {
+        if (first.empty()) {
+            return;
+        }
+        if (dirty) {
+            color(objects.size());
+        }
+        if (motion_threshold > 0.0f) {
+            moving.assign(size(), 0);
+        }
+        const uint32_t colors_count = getColorsCount();
+        for (uint32_t c{0}; c < colors_count; ++c) {
+            const uint32_t offset = color_offsets[c];
+            thread_pool.dispatch(color_offsets[c + 1] - offset, [&](uint32_t start, uint32_t end) {
+                solveRange(objects, offset + start, offset + end, motion_threshold);
+            });
+        }
+        solveRange(objects, color_offsets[colors_count], color_offsets[colors_count + 1], motion_threshold);
+    }
+
+    template<typename TObjects>
+    void solveRange(TObjects& objects, uint32_t start, uint32_t end, float motion_threshold)
+    {
+        for (uint32_t i{start}; i < end; ++i) {
+            auto& object_1 = objects.data[first[i]];
+            auto& object_2 = objects.data[second[i]];
+            const Vec2  v    = object_1.getPosition() - object_2.getPosition();
+            const float dist = MathVec2::length(v);
+            if (dist > 0.0f) {
+                const float inverse_mass_1 = getInverseMass(object_1);
+                const float inverse_mass_2 = getInverseMass(object_2);
+                const float delta = stiffness[i] * (length[i] - dist) / (dist * (inverse_mass_1 + inverse_mass_2));
+                object_1.move(v * (delta * inverse_mass_1));
+                object_2.move(v * (-delta * inverse_mass_2));
+                if (motion_threshold > 0.0f) {
+                    moving[i] = std::abs(delta) * dist * std::max(inverse_mass_1, inverse_mass_2) > motion_threshold;
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,265 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <SFML/Graphics/Image.hpp>
+#include "engine/common/grid.hpp"
+#include "engine/common/utils.hpp"
+#include "engine/common/math.hpp"
+
+
+// Static obstacles baked in a signed distance field, negative inside the obstacles.
+// Obstacles are added at load time, then resolving an object costs a single bilinear lookup
+// whatever the number and the complexity of the obstacles.
+// Samples are cell_size apart, sample (x, y) is at world position (x, y) * cell_size.
+// Distances are clamped to band so each obstacle is only baked around its bounding box,
+// the band has to be larger than the objects' radius.
+struct DistanceField
+{
+    struct Sample
+    {
+        float distance;
+        // Not normalized
+        Vec2  gradient;
+    };
+
+    Vec2        world_size    = {0.0f, 0.0f};
+    float       cell_size     = 0.5f;
+    float       inv_cell_size = 2.0f;
+    float       band          = 4.0f;
+    // Only allocated once the first obstacle is added
+    Grid<float> distances;
+
+    DistanceField() = default;
+
+    explicit
+    DistanceField(Vec2 world_size_, float cell_size_ = 0.5f)
+        : world_size{world_size_}
+        , cell_size{cell_size_}
+        , inv_cell_size{1.0f / cell_size_}
+    {}
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return distances.data.empty();
+    }
+
+    void clear()
+    {
+        distances = Grid<float>();
+    }
+
+    void addCircle(Vec2 center, float radius)
+    {
+        bake(center - Vec2{radius, radius}, center + Vec2{radius, radius}, [=](Vec2 p) {
+            return MathVec2::length(p - center) - radius;
+        });
+    }
+
+    // Segment [a, b] with rounded ends
+    void addCapsule(Vec2 a, Vec2 b, float radius)
+    {
+        const Vec2  ab      = b - a;
+        const float inv_ab2 = 1.0f / std::max(MathVec2::length2(ab), 1e-12f);
+        const Vec2 min{std::min(a.x, b.x) - radius, std::min(a.y, b.y) - radius};
+        const Vec2 max{std::max(a.x, b.x) + radius, std::max(a.y, b.y) + radius};
+        bake(min, max, [=](Vec2 p) {
+            const float t = std::min(std::max(MathVec2::dot(p - a, ab) * inv_ab2, 0.0f), 1.0f);
+            return MathVec2::length(p - (a + ab * t)) - radius;
+        });
+    }
+
+    // Simple polygon, in any winding order
+    void addPolygon(const std::vector<Vec2>& points)
+    {
+        const auto count = to<uint32_t>(points.size());
+        if (count < 3) {
+            return;
+        }
+        Vec2 min = points[0];
+        Vec2 max = points[0];
+        for (const Vec2 point : points) {
+            min = {std::min(min.x, point.x), std::min(min.y, point.y)};
+            max = {std::max(max.x, point.x), std::max(max.y, point.y)};
+        }
+        bake(min, max, [&](Vec2 p) {
+            float min_dist2 = std::numeric_limits<float>::max();
+            bool  inside    = false;
+            for (uint32_t i{0}, j{count - 1}; i < count; j = i++) {
+                const Vec2  a  = points[j];
+                const Vec2  b  = points[i];
+                const Vec2  ab = b - a;
+                const float t  = std::min(std::max(MathVec2::dot(p - a, ab) / std::max(MathVec2::length2(ab), 1e-12f), 0.0f), 1.0f);
+                min_dist2 = std::min(min_dist2, MathVec2::length2(p - (a + ab * t)));
+                // Crossing number
+                if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * ab.x / ab.y) {
+                    inside = !inside;
+                }
+            }
+            const float dist = std::sqrt(min_dist2);
+            return inside ? -dist : dist;
+        });
+    }
+
+    // Solid cells of a mask covering the world rectangle [position, position + size], row by row
+    void addMask(const std::vector<uint8_t>& solid, uint32_t mask_width, uint32_t mask_height, Vec2 position, Vec2 size)
+    {
+        allocate();
+        const int32_t width  = distances.width;
+        const int32_t height = distances.height;
+        // Mask resampled on the field's samples
+        std::vector<uint8_t> inside(to<uint64_t>(width) * height, 0);
+        for (int32_t y{0}; y < height; ++y) {
+            for (int32_t x{0}; x < width; ++x) {
+                const Vec2 uv = (Vec2{to<float>(x), to<float>(y)} * cell_size - position);
+                const auto mask_x = to<int32_t>(std::floor(uv.x / size.x * to<float>(mask_width)));
+                const auto mask_y = to<int32_t>(std::floor(uv.y / size.y * to<float>(mask_height)));
+                if (mask_x >= 0 && mask_y >= 0 && mask_x < to<int32_t>(mask_width) && mask_y < to<int32_t>(mask_height)) {
+                    inside[y * width + x] = solid[mask_y * mask_width + mask_x];
+                }
+            }
+        }
+        // Distance to the closest sample of the other kind, boundaries are half a cell away from the samples.
+        // Clamped to [-band, band], samples without any sample of the other kind get the band
+        const std::vector<float> to_solid = computeSquaredDistances(inside, 1);
+        const std::vector<float> to_empty = computeSquaredDistances(inside, 0);
+        for (uint32_t i{0}; i < inside.size(); ++i) {
+            const float dist = inside[i] ? -(std::sqrt(to_empty[i]) - 0.5f) : (std::sqrt(to_solid[i]) - 0.5f);
+            distances.data[i] = std::min(distances.data[i], std::max(std::min(dist * cell_size, band), -band));
+        }
+    }
+
+    // Pixels with an alpha above the threshold are solid, the image covers the world rectangle [position, position + size]
+    void addImage(const sf::Image& image, Vec2 position, Vec2 size, uint8_t alpha_threshold = 127)
+    {
+        const sf::Vector2u image_size = image.getSize();
+        std::vector<uint8_t> solid(to<uint64_t>(image_size.x) * image_size.y);
+        for (uint32_t y{0}; y < image_size.y; ++y) {
+            for (uint32_t x{0}; x < image_size.x; ++x) {
+                solid[y * image_size.x + x] = image.getPixel(x, y).a > alpha_threshold;
+            }
+        }
+        addMask(solid, image_size.x, image_size.y, position, size);
+    }
+
+    // Bilinear interpolation of the distance and its derivatives in the cell containing position
+    [[nodiscard]]
+    Sample sample(Vec2 position) const
+    {
+        const float gx = std::min(std::max(position.x * inv_cell_size, 0.0f), to<float>(distances.width  - 2));
+        const float gy = std::min(std::max(position.y * inv_cell_size, 0.0f), to<float>(distances.height - 2));
+        const auto  x  = to<int32_t>(gx);
+        const auto  y  = to<int32_t>(gy);
+        const float tx = gx - to<float>(x);
+        const float ty = gy - to<float>(y);
+        const float* row_0 = &distances.data[y * distances.width + x];
+        const float* row_1 = row_0 + distances.width;
+        const float d00 = row_0[0];
+        const float d10 = row_0[1];
+        const float d01 = row_1[0];
+        const float d11 = row_1[1];
+        const float top    = d00 + (d10 - d00) * tx;
+        const float bottom = d01 + (d11 - d01) * tx;
+        const float dx = (d10 - d00) + ((d11 - d01) - (d10 - d00)) * ty;
+        const float dy = bottom - top;
+        return {top + dy * ty, Vec2{dx, dy} * inv_cell_size};
+    }
+
+private:
+    void allocate()
+    {
+        if (empty()) {
+            const int32_t width  = to<int32_t>(std::ceil(world_size.x * inv_cell_size)) + 1;
+            const int32_t height = to<int32_t>(std::ceil(world_size.y * inv_cell_size)) + 1;
+            distances = Grid<float>(width, height);
+            std::fill(distances.data.begin(), distances.data.end(), band);
+        }
+    }
+
+    // Union of the obstacles, each sample of the bounding box [min, max] extended by the band keeps the closest one
+    template<typename TDistance>
+    void bake(Vec2 min, Vec2 max, TDistance&& distance)
+    {
+        allocate();
+        const int32_t x_min = std::max(to<int32_t>(std::floor((min.x - band) * inv_cell_size)), 0);
+        const int32_t y_min = std::max(to<int32_t>(std::floor((min.y - band) * inv_cell_size)), 0);
+        const int32_t x_max = std::min(to<int32_t>(std::ceil((max.x + band) * inv_cell_size)), distances.width  - 1);
+        const int32_t y_max = std::min(to<int32_t>(std::ceil((max.y + band) * inv_cell_size)), distances.height - 1);
+        for (int32_t y{y_min}; y <= y_max; ++y) {
+            for (int32_t x{x_min}; x <= x_max; ++x) {
+                float& d = distances.get(x, y);
+                d = std::min(d, distance(Vec2{to<float>(x), to<float>(y)} * cell_size));
+            }
+        }
+    }
+
+    // Squared distance in samples from each sample to the closest sample equal to target,
+    // exact euclidean distance transform done in two separable passes (Felzenszwalb and Huttenlocher)
+    [[nodiscard]]
+    std::vector<float> computeSquaredDistances(const std::vector<uint8_t>& mask, uint8_t target) const
+    {
+        const int32_t width  = distances.width;
+        const int32_t height = distances.height;
+        constexpr float far  = 1e20f;
+        std::vector<float> result(mask.size());
+        for (uint32_t i{0}; i < mask.size(); ++i) {
+            result[i] = mask[i] == target ? 0.0f : far;
+        }
+        const int32_t max_size = std::max(width, height);
+        std::vector<float>   f(max_size);
+        std::vector<float>   d(max_size);
+        std::vector<int32_t> v(max_size);
+        std::vector<float>   z(max_size + 1);
+        // Columns
+        for (int32_t x{0}; x < width; ++x) {
+            for (int32_t y{0}; y < height; ++y) {
+                f[y] = result[y * width + x];
+            }
+            transform1D(f.data(), d.data(), v.data(), z.data(), height);
+            for (int32_t y{0}; y < height; ++y) {
+                result[y * width + x] = d[y];
+            }
+        }
+        // Rows
+        for (int32_t y{0}; y < height; ++y) {
+            transform1D(&result[y * width], d.data(), v.data(), z.data(), width);
+            std::copy(d.begin(), d.begin() + width, result.begin() + y * width);
+        }
+        return result;
+    }
+
+    // Lower envelope of the parabolas rooted at each sample
+    static void transform1D(const float* f, float* d, int32_t* v, float* z, int32_t n)
+    {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        int32_t k{0};
+        v[0] = 0;
+        z[0] = -inf;
+        z[1] = inf;
+        for (int32_t q{1}; q < n; ++q) {
+            const auto intersection = [&](int32_t p) {
+                return ((f[q] + to<float>(q * q)) - (f[p] + to<float>(p * p))) / to<float>(2 * q - 2 * p);
+            };
+            float s = intersection(v[k]);
+            while (s <= z[k]) {
+                --k;
+                s = intersection(v[k]);
+            }
+            ++k;
+            v[k]     = q;
+            z[k]     = s;
+            z[k + 1] = inf;
+        }
+        k = 0;
+        for (int32_t q{0}; q < n; ++q) {
+            while (z[k + 1] < to<float>(q)) {
+                ++k;
+            }
+            const auto delta = to<float>(q - v[k]);
+            d[q] = delta * delta + f[v[k]];
+        }
+    }
+};
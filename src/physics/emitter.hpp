@@ -0,0 +1,34 @@
+#pragma once
+#include "physics.hpp"
+#include "engine/common/palette.hpp"
+
+
+// Spawns a line of objects at each update until the solver holds max_objects objects
+struct Emitter
+{
+    // Position of the first object of a batch and offset between two consecutive ones
+    Vec2     position         = {0.0f, 0.0f};
+    Vec2     spacing          = {0.0f, 1.0f};
+    // Initial displacement per sub step
+    Vec2     velocity         = {0.0f, 0.0f};
+    uint32_t objects_per_step = 1;
+    uint32_t max_objects      = 0;
+    // Palette entries per object ID, by default the palette loops every ~31k objects
+    float    color_speed      = 0.0001f * to<float>(Palette::default_size) / Math::PI;
+    bool     active           = true;
+
+    template<typename TSolver>
+    void update(TSolver& solver) const
+    {
+        const auto objects_count = to<uint32_t>(solver.objects.size());
+        if (!active || objects_count >= max_objects) {
+            return;
+        }
+        const uint32_t count = std::min(objects_per_step, max_objects - objects_count);
+        solver.createObjects(count, [this](uint32_t i, civ::ID id, auto& obj, ColorIndex& color) {
+            obj.setPosition(position + spacing * to<float>(i));
+            obj.addVelocity(velocity);
+            color = to<ColorIndex>(to<uint64_t>(to<float>(id) * color_speed) % Palette::default_size);
+        });
+    }
+};
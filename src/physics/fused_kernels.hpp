@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include "engine/common/math.hpp"
+#include "engine/common/index_vector.hpp"
+#include "engine/common/palette.hpp"
+
+
+// User per object kernels applied inside the integration pass instead of their own pass over the objects.
+// A kernel is any callable kernel(data_index, object, dt), it is called right before the object is
+// integrated (forces, attribute updates). Kernels wrapped with fused::afterIntegration are called
+// right after (constraints on positions).
+// Kernels are called from the solver's threads for different objects, they are inlined in the
+// integration loop (no virtual call nor std::function). They run at each sub step and skip the sleeping objects.
+namespace fused
+{
+
+// Objects are processed by blocks small enough to stay in cache between the kernels and the integration
+constexpr uint32_t block_size = 256;
+
+template<typename TKernel>
+struct PostIntegration
+{
+    TKernel kernel;
+};
+
+template<typename TKernel>
+PostIntegration<std::decay_t<TKernel>> afterIntegration(TKernel&& kernel)
+{
+    return {std::forward<TKernel>(kernel)};
+}
+
+template<typename TKernel>
+struct IsPostIntegration : std::false_type {};
+
+template<typename TKernel>
+struct IsPostIntegration<PostIntegration<TKernel>> : std::true_type {};
+
+template<typename TKernel, typename TObject>
+inline void applyPre(TKernel& kernel, uint64_t index, TObject& object, float dt)
+{
+    if constexpr (!IsPostIntegration<std::decay_t<TKernel>>::value) {
+        kernel(index, object, dt);
+    }
+}
+
+template<typename TKernel, typename TObject>
+inline void applyPost(TKernel& kernel, uint64_t index, TObject& object, float dt)
+{
+    if constexpr (IsPostIntegration<std::decay_t<TKernel>>::value) {
+        kernel.kernel(index, object, dt);
+    }
+}
+
+}
+
+
+// Ready to use kernels
+namespace kernels
+{
+
+// Pulls objects toward a point, the force decreases with the distance
+struct Attractor
+{
+    Vec2  center   = {0.0f, 0.0f};
+    float strength = 1000.0f;
+    float min_distance = 1.0f;
+
+    template<typename TObject>
+    void operator()(uint64_t, TObject& object, float) const
+    {
+        const Vec2  to_center = center - object.position;
+        const float dist      = std::max(MathVec2::length(to_center), min_distance);
+        object.acceleration += to_center * (strength / (dist * dist * dist));
+    }
+};
+
+// Constant acceleration in a rectangular area, for wind or conveyor belts
+struct ForceField
+{
+    Vec2 min_position = {0.0f, 0.0f};
+    Vec2 max_position = {0.0f, 0.0f};
+    Vec2 acceleration = {0.0f, 0.0f};
+
+    template<typename TObject>
+    void operator()(uint64_t, TObject& object, float) const
+    {
+        const Vec2 p = object.position;
+        if (p.x >= min_position.x && p.x < max_position.x && p.y >= min_position.y && p.y < max_position.y) {
+            object.acceleration += acceleration;
+        }
+    }
+};
+
+// Sets objects colors from their speed, colors are picked along the palette.
+// The renderer only writes the colors of new objects unless its dynamic_colors is set
+struct ColorBySpeed
+{
+    civ::PagedArray<ColorIndex>& color_indices;
+    // Displacement per sub step mapped to the end of the palette
+    float    max_speed    = 0.1f;
+    uint32_t palette_size = Palette::default_size;
+
+    template<typename TObject>
+    void operator()(uint64_t index, TObject& object, float) const
+    {
+        const float ratio = std::min(object.getSpeed() / max_speed, 1.0f);
+        color_indices[index] = static_cast<ColorIndex>(ratio * static_cast<float>(palette_size - 1));
+    }
+};
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include "physic_object.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define VERLET_INTEGRATOR_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define VERLET_TARGET_AVX
+    #else
+        #define VERLET_TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+
+// Fused integration pass: gravity, Verlet step, damping and border clamping in a single streaming loop.
+// The kernels produce the same results as PhysicObject::update followed by the border clamp.
+// They work on any object type extending PhysicObject, other members are left untouched.
+namespace integrator
+{
+
+struct Parameters
+{
+    Vec2  gravity;
+    float dt;
+    float damping;
+    Vec2  min_position;
+    Vec2  max_position;
+};
+
+enum class Kind
+{
+    Scalar,
+    SSE,
+    AVX,
+};
+
+template<typename TObject>
+using BasicKernel = void(*)(TObject*, uint32_t, const Parameters&);
+using Kernel = BasicKernel<PhysicObject>;
+
+inline const char* getName(Kind kind)
+{
+    switch (kind) {
+        case Kind::Scalar: return "scalar";
+        case Kind::SSE:    return "sse";
+        case Kind::AVX:    return "avx";
+    }
+    return "unknown";
+}
+
+template<typename TObject>
+inline void integrateScalar(TObject* objects, uint32_t count, const Parameters& params)
+{
+    const float dt2 = params.dt * params.dt;
+    for (uint32_t i{0}; i < count; ++i) {
+        TObject& obj = objects[i];
+        const Vec2 acceleration     = obj.acceleration + params.gravity;
+        const Vec2 last_update_move = obj.position - obj.last_position;
+        const Vec2 new_position     = obj.position + last_update_move + (acceleration - last_update_move * params.damping) * dt2;
+        obj.last_position = obj.position;
+        obj.position.x    = std::min(std::max(new_position.x, params.min_position.x), params.max_position.x);
+        obj.position.y    = std::min(std::max(new_position.y, params.min_position.y), params.max_position.y);
+        obj.acceleration  = {0.0f, 0.0f};
+    }
+}
+
+#ifdef VERLET_INTEGRATOR_X86
+
+// The vector kernels load position and last_position as a single 128 bits value
+static_assert(offsetof(PhysicObject, position)      == 0);
+static_assert(offsetof(PhysicObject, last_position) == 2 * sizeof(float));
+static_assert(offsetof(PhysicObject, acceleration)  == 4 * sizeof(float));
+
+// One object per iteration, lanes are [x, y, x, y]
+template<typename TObject>
+inline void integrateSSE(TObject* objects, uint32_t count, const Parameters& params)
+{
+    const __m128 gravity = _mm_setr_ps(params.gravity.x, params.gravity.y, 0.0f, 0.0f);
+    const __m128 damping = _mm_set1_ps(params.damping);
+    const __m128 dt2     = _mm_set1_ps(params.dt * params.dt);
+    const __m128 min_pos = _mm_setr_ps(params.min_position.x, params.min_position.y, 0.0f, 0.0f);
+    const __m128 max_pos = _mm_setr_ps(params.max_position.x, params.max_position.y, 0.0f, 0.0f);
+    const __m128 zero    = _mm_setzero_ps();
+    for (uint32_t i{0}; i < count; ++i) {
+        float* obj = &objects[i].position.x;
+        const __m128 pos_last     = _mm_loadu_ps(obj);
+        const __m128 last         = _mm_movehl_ps(pos_last, pos_last);
+        const __m128 acceleration = _mm_add_ps(_mm_loadl_pi(zero, reinterpret_cast<const __m64*>(obj + 4)), gravity);
+        const __m128 move         = _mm_sub_ps(pos_last, last);
+        const __m128 correction   = _mm_mul_ps(_mm_sub_ps(acceleration, _mm_mul_ps(move, damping)), dt2);
+        const __m128 new_position = _mm_add_ps(_mm_add_ps(pos_last, move), correction);
+        const __m128 clamped      = _mm_min_ps(_mm_max_ps(new_position, min_pos), max_pos);
+        _mm_storeu_ps(obj, _mm_movelh_ps(clamped, pos_last));
+        _mm_storel_pi(reinterpret_cast<__m64*>(obj + 4), zero);
+    }
+}
+
+// Two objects per iteration, the object stride does not allow wider contiguous loads
+template<typename TObject>
+VERLET_TARGET_AVX
+inline void integrateAVX(TObject* objects, uint32_t count, const Parameters& params)
+{
+    const __m256 gravity = _mm256_setr_ps(params.gravity.x, params.gravity.y, 0.0f, 0.0f, params.gravity.x, params.gravity.y, 0.0f, 0.0f);
+    const __m256 damping = _mm256_set1_ps(params.damping);
+    const __m256 dt2     = _mm256_set1_ps(params.dt * params.dt);
+    const __m256 min_pos = _mm256_setr_ps(params.min_position.x, params.min_position.y, 0.0f, 0.0f, params.min_position.x, params.min_position.y, 0.0f, 0.0f);
+    const __m256 max_pos = _mm256_setr_ps(params.max_position.x, params.max_position.y, 0.0f, 0.0f, params.max_position.x, params.max_position.y, 0.0f, 0.0f);
+    const __m128 zero    = _mm_setzero_ps();
+    uint32_t i{0};
+    for (; i + 1 < count; i += 2) {
+        float* obj_1 = &objects[i    ].position.x;
+        float* obj_2 = &objects[i + 1].position.x;
+        const __m256 pos_last     = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(obj_1)), _mm_loadu_ps(obj_2), 1);
+        const __m256 last         = _mm256_permute_ps(pos_last, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m128 acc_1        = _mm_loadl_pi(zero, reinterpret_cast<const __m64*>(obj_1 + 4));
+        const __m128 acc_2        = _mm_loadl_pi(zero, reinterpret_cast<const __m64*>(obj_2 + 4));
+        const __m256 acceleration = _mm256_add_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(acc_1), acc_2, 1), gravity);
+        const __m256 move         = _mm256_sub_ps(pos_last, last);
+        const __m256 correction   = _mm256_mul_ps(_mm256_sub_ps(acceleration, _mm256_mul_ps(move, damping)), dt2);
+        const __m256 new_position = _mm256_add_ps(_mm256_add_ps(pos_last, move), correction);
+        const __m256 clamped      = _mm256_min_ps(_mm256_max_ps(new_position, min_pos), max_pos);
+        // Low half of each lane gets the new position, high half the previous one
+        const __m256 result       = _mm256_shuffle_ps(clamped, pos_last, _MM_SHUFFLE(1, 0, 1, 0));
+        _mm_storeu_ps(obj_1, _mm256_castps256_ps128(result));
+        _mm_storeu_ps(obj_2, _mm256_extractf128_ps(result, 1));
+        _mm_storel_pi(reinterpret_cast<__m64*>(obj_1 + 4), zero);
+        _mm_storel_pi(reinterpret_cast<__m64*>(obj_2 + 4), zero);
+    }
+    // Remaining object, if any
+    integrateSSE(objects + i, count - i, params);
+}
+
+inline bool isAVXSupported()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int32_t info[4];
+    __cpuid(info, 1);
+    const bool os_uses_xsave = (info[2] & (1 << 27)) != 0;
+    const bool cpu_has_avx   = (info[2] & (1 << 28)) != 0;
+    return os_uses_xsave && cpu_has_avx && ((_xgetbv(0) & 0x6) == 0x6);
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+inline bool isSupported(Kind kind)
+{
+    switch (kind) {
+        case Kind::Scalar:
+            return true;
+#ifdef VERLET_INTEGRATOR_X86
+        case Kind::SSE:
+            return true;
+        case Kind::AVX:
+            return isAVXSupported();
+#endif
+        default:
+            return false;
+    }
+}
+
+template<typename TObject = PhysicObject>
+inline BasicKernel<TObject> getKernel(Kind kind)
+{
+    static_assert(std::is_base_of_v<PhysicObject, TObject>, "The kernels need the PhysicObject layout");
+    switch (kind) {
+#ifdef VERLET_INTEGRATOR_X86
+        case Kind::SSE: return integrateSSE<TObject>;
+        case Kind::AVX: return integrateAVX<TObject>;
+#endif
+        default:        return integrateScalar<TObject>;
+    }
+}
+
+// Best kernel available on the running CPU
+inline Kind detect()
+{
+    static const Kind best = isSupported(Kind::AVX) ? Kind::AVX : (isSupported(Kind::SSE) ? Kind::SSE : Kind::Scalar);
+    return best;
+}
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <type_traits>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#include "collision_grid.hpp"
+#include "engine/common/utils.hpp"
+
+
+// Index of the lowest set bit, bits must not be 0
+inline uint32_t getLowestBitIndex(uint64_t bits)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+}
+
+
+// Broadphase for objects of different sizes. The cells of level k are TBaseCellSize * 2^k wide and
+// an object goes in the first level whose cells are at least as large as its diameter, this way small
+// objects keep small cells. Two objects of the same level are in neighbor cells of that level and a
+// smaller object is in the 3x3 cells of the lower level covering the neighbors of the larger one's cell.
+// Objects larger than the cells of the last level are not supported.
+// Each level has a border of empty cells so the neighbors of any object's cell exist.
+template<uint8_t TLevelCount = 4, uint8_t TCapacity = 8, uint32_t TBaseCellSize = 1>
+struct BasicMultiLevelGrid
+{
+    static constexpr uint32_t level_count = TLevelCount;
+    using Cell = BasicCollisionCell<TCapacity>;
+
+    struct Level
+    {
+        BasicCollisionGrid<TCapacity> cells;
+        float                         cell_size     = 1.0f;
+        float                         inv_cell_size = 1.0f;
+        // Allows to skip the levels without objects
+        uint32_t                      objects_count = 0;
+        // Most cells of the coarse levels are empty, only the used ones are cleared
+        std::vector<uint32_t>         used_cells;
+        // One bit per cell, set for the used cells so the collision pass does not walk the empty ones
+        std::vector<uint64_t>         used_mask;
+
+        // Calls callback(index, x, y) for the used cells in [start, end), in memory order
+        template<typename TCallback>
+        void forEachUsedCell(uint32_t start, uint32_t end, TCallback&& callback) const
+        {
+            for (uint32_t word{start >> 6}; (word << 6) < end; ++word) {
+                uint64_t bits = used_mask[word];
+                const uint32_t word_start = word << 6;
+                if (word_start < start) {
+                    bits &= ~uint64_t{0} << (start - word_start);
+                }
+                if (end - word_start < 64) {
+                    bits &= (uint64_t{1} << (end - word_start)) - 1;
+                }
+                while (bits) {
+                    const uint32_t   index  = word_start + getLowestBitIndex(bits);
+                    const GridCoords coords = cells.getCoords(index);
+                    callback(index, coords.x, coords.y);
+                    bits &= bits - 1;
+                }
+            }
+        }
+    };
+
+    std::array<Level, TLevelCount> levels;
+
+    BasicMultiLevelGrid() = default;
+
+    BasicMultiLevelGrid(int32_t width, int32_t height)
+    {
+        float cell_size = to<float>(TBaseCellSize);
+        for (Level& level : levels) {
+            const auto level_width  = to<int32_t>(std::ceil(to<float>(width)  / cell_size)) + 2;
+            const auto level_height = to<int32_t>(std::ceil(to<float>(height) / cell_size)) + 2;
+            level.cells         = BasicCollisionGrid<TCapacity>(level_width, level_height);
+            level.used_mask.assign((level.cells.data.size() + 63) / 64, 0);
+            level.cell_size     = cell_size;
+            level.inv_cell_size = 1.0f / cell_size;
+            cell_size *= 2.0f;
+        }
+    }
+
+    [[nodiscard]]
+    static uint32_t getLevel(float radius)
+    {
+        const float diameter  = 2.0f * radius;
+        float       cell_size = to<float>(TBaseCellSize);
+        uint32_t    level{0};
+        while (level + 1 < TLevelCount && cell_size < diameter) {
+            cell_size *= 2.0f;
+            ++level;
+        }
+        return level;
+    }
+
+    // The position has to be in [0, world_size)
+    // Returns false if the cell was full, the object is then dropped
+    bool addAtom(Vec2 position, float radius, uint32_t atom)
+    {
+        Level& level = levels[getLevel(radius)];
+        const int32_t x = std::min(to<int32_t>(position.x * level.inv_cell_size) + 1, level.cells.width  - 2);
+        const int32_t y = std::min(to<int32_t>(position.y * level.inv_cell_size) + 1, level.cells.height - 2);
+        const uint32_t index = level.cells.getIndex(x, y);
+        Cell& cell = level.cells.data[index];
+        if (!cell.objects_count) {
+            level.used_cells.push_back(index);
+            level.used_mask[index >> 6] |= uint64_t{1} << (index & 63);
+        }
+        const bool added = cell.addAtom(atom);
+        level.objects_count += added;
+        return added;
+    }
+
+    void clear()
+    {
+        for (Level& level : levels) {
+            for (const uint32_t index : level.used_cells) {
+                level.cells.data[index].clear();
+                level.used_mask[index >> 6] = 0;
+            }
+            level.used_cells.clear();
+            level.objects_count = 0;
+        }
+    }
+};
+
+using MultiLevelGrid = BasicMultiLevelGrid<>;
+
+
+template<typename TBroadphase>
+struct IsMultiLevelGrid : std::false_type {};
+
+template<uint8_t TLevelCount, uint8_t TCapacity, uint32_t TBaseCellSize>
+struct IsMultiLevelGrid<BasicMultiLevelGrid<TLevelCount, TCapacity, TBaseCellSize>> : std::true_type {};
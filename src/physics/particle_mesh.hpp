@@ -0,0 +1,296 @@
+#pragma once
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cmath>
+#include "distance_constraints.hpp"
+#include "engine/common/grid.hpp"
+#include "engine/common/utils.hpp"
+#include "engine/common/math.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+namespace fft
+{
+
+using Complex = std::complex<float>;
+
+// Roots of unity of a power of two size, computed in double precision
+inline std::vector<Complex> createTwiddles(uint32_t size)
+{
+    std::vector<Complex> twiddles(size / 2);
+    for (uint32_t i{0}; i < size / 2; ++i) {
+        const double angle = -2.0 * Math::PI * to<double>(i) / to<double>(size);
+        twiddles[i] = Complex(to<float>(std::cos(angle)), to<float>(std::sin(angle)));
+    }
+    return twiddles;
+}
+
+// In place radix-2 transform, the inverse is not normalized
+inline void transform(Complex* data, uint32_t size, const std::vector<Complex>& twiddles, bool inverse)
+{
+    for (uint32_t i{1}, j{0}; i < size; ++i) {
+        uint32_t bit = size >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    for (uint32_t length{2}; length <= size; length <<= 1) {
+        const uint32_t half   = length / 2;
+        const uint32_t stride = size / length;
+        for (uint32_t i{0}; i < size; i += length) {
+            for (uint32_t k{0}; k < half; ++k) {
+                const Complex w = inverse ? std::conj(twiddles[k * stride]) : twiddles[k * stride];
+                const Complex u = data[i + k];
+                const Complex v = data[i + k + half] * w;
+                data[i + k]        = u + v;
+                data[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+inline uint32_t getNextPowerOfTwo(uint32_t value)
+{
+    uint32_t result{1};
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+
+// Long range forces between all the objects (gravity wells, charge-like repulsion) computed on a coarse grid:
+// - the objects' masses are deposited on the grid nodes (cloud in cell)
+// - the potential is the convolution of the masses with the 1/r kernel, done with FFTs on a grid padded to
+//   twice its size so the objects only interact with each other (open boundaries)
+// - accelerations are the potential gradient, interpolated back at the objects' positions
+// Node (x, y) is at world position (x + 0.5, y + 0.5) * cell_size.
+struct ParticleMesh
+{
+    // Positive attracts, negative repels, 0 disables the long range forces
+    float    strength  = 0.0f;
+    float    cell_size = 8.0f;
+    int32_t  width     = 0;
+    int32_t  height    = 0;
+
+    Grid<float> density;
+    Grid<float> potential;
+    Grid<Vec2>  acceleration;
+
+    ParticleMesh() = default;
+
+    explicit
+    ParticleMesh(Vec2 world_size, float cell_size_ = 8.0f)
+    {
+        setWorldSize(world_size, cell_size_);
+    }
+
+    void setWorldSize(Vec2 world_size, float cell_size_)
+    {
+        cell_size = cell_size_;
+        width     = to<int32_t>(std::ceil(world_size.x / cell_size));
+        height    = to<int32_t>(std::ceil(world_size.y / cell_size));
+        density      = Grid<float>(width, height);
+        potential    = Grid<float>(width, height);
+        acceleration = Grid<Vec2>(width, height);
+        padded_width  = fft::getNextPowerOfTwo(2 * width);
+        padded_height = fft::getNextPowerOfTwo(2 * height);
+        // The FFT buffers are only allocated when the forces are first computed
+        buffer.clear();
+        kernel_spectrum.clear();
+        batch_density.clear();
+    }
+
+    [[nodiscard]]
+    bool isEnabled() const
+    {
+        return strength != 0.0f && width > 1 && height > 1;
+    }
+
+    // Computes the accelerations from the current positions, called once per update
+    template<typename TObjects>
+    void update(tp::ThreadPool& thread_pool, const TObjects& objects)
+    {
+        if (kernel_spectrum.empty()) {
+            createKernelSpectrum(thread_pool);
+        }
+        deposit(thread_pool, objects);
+        solvePotential(thread_pool);
+        computeAcceleration(thread_pool);
+    }
+
+    // Cloud in cell interpolation of the accelerations
+    [[nodiscard]]
+    Vec2 getAcceleration(Vec2 position) const
+    {
+        const CellWeights w = getWeights(position);
+        return (acceleration.get(w.x, w.y)     * (1.0f - w.tx) + acceleration.get(w.x + 1, w.y)     * w.tx) * (1.0f - w.ty) +
+               (acceleration.get(w.x, w.y + 1) * (1.0f - w.tx) + acceleration.get(w.x + 1, w.y + 1) * w.tx) * w.ty;
+    }
+
+private:
+    struct CellWeights
+    {
+        int32_t x, y;
+        float   tx, ty;
+    };
+
+    uint32_t padded_width  = 0;
+    uint32_t padded_height = 0;
+    // Padded grid, rows of padded_width values
+    std::vector<fft::Complex> buffer;
+    std::vector<fft::Complex> kernel_spectrum;
+    std::vector<fft::Complex> twiddles_x;
+    std::vector<fft::Complex> twiddles_y;
+    // One density grid per batch, summed afterward
+    std::vector<Grid<float>>  batch_density;
+
+    // Positions out of the grid are clamped to its border nodes
+    [[nodiscard]]
+    CellWeights getWeights(Vec2 position) const
+    {
+        const float gx = std::min(std::max(position.x / cell_size - 0.5f, 0.0f), to<float>(width  - 1) - 0.001f);
+        const float gy = std::min(std::max(position.y / cell_size - 0.5f, 0.0f), to<float>(height - 1) - 0.001f);
+        const auto  x  = to<int32_t>(gx);
+        const auto  y  = to<int32_t>(gy);
+        return {x, y, gx - to<float>(x), gy - to<float>(y)};
+    }
+
+    template<typename TObjects>
+    void deposit(tp::ThreadPool& thread_pool, const TObjects& objects)
+    {
+        const uint32_t batch_count = thread_pool.m_thread_count;
+        batch_density.resize(batch_count, Grid<float>(width, height));
+        const auto     objects_count = to<uint32_t>(objects.size());
+        const uint32_t batch_size    = objects_count / batch_count + 1;
+        thread_pool.dispatch(batch_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t batch{start}; batch < end; ++batch) {
+                Grid<float>& grid = batch_density[batch];
+                std::fill(grid.data.begin(), grid.data.end(), 0.0f);
+                const uint32_t first = batch * batch_size;
+                const uint32_t last  = std::min(first + batch_size, objects_count);
+                for (uint32_t i{first}; i < last; ++i) {
+                    const auto& object = objects.data[i];
+                    const float mass   = 1.0f / getInverseMass(object);
+                    const CellWeights w = getWeights(object.getPosition());
+                    grid.get(w.x,     w.y)     += mass * (1.0f - w.tx) * (1.0f - w.ty);
+                    grid.get(w.x + 1, w.y)     += mass * w.tx * (1.0f - w.ty);
+                    grid.get(w.x,     w.y + 1) += mass * (1.0f - w.tx) * w.ty;
+                    grid.get(w.x + 1, w.y + 1) += mass * w.tx * w.ty;
+                }
+            }
+        });
+        thread_pool.dispatch(to<uint32_t>(density.data.size()), [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                float sum = 0.0f;
+                for (const Grid<float>& grid : batch_density) {
+                    sum += grid.data[i];
+                }
+                density.data[i] = sum;
+            }
+        });
+    }
+
+    // Rows in [0, rows_count) then all the columns, or the reverse for the inverse transform
+    void transform2D(tp::ThreadPool& thread_pool, uint32_t rows_count, bool inverse)
+    {
+        const auto transform_rows = [&]() {
+            thread_pool.dispatch(rows_count, [&](uint32_t start, uint32_t end) {
+                for (uint32_t y{start}; y < end; ++y) {
+                    fft::transform(&buffer[y * padded_width], padded_width, twiddles_x, inverse);
+                }
+            });
+        };
+        const auto transform_columns = [&]() {
+            thread_pool.dispatch(padded_width, [&](uint32_t start, uint32_t end) {
+                std::vector<fft::Complex> column(padded_height);
+                for (uint32_t x{start}; x < end; ++x) {
+                    for (uint32_t y{0}; y < padded_height; ++y) {
+                        column[y] = buffer[y * padded_width + x];
+                    }
+                    fft::transform(column.data(), padded_height, twiddles_y, inverse);
+                    for (uint32_t y{0}; y < padded_height; ++y) {
+                        buffer[y * padded_width + x] = column[y];
+                    }
+                }
+            });
+        };
+        if (inverse) {
+            transform_columns();
+            transform_rows();
+        } else {
+            transform_rows();
+            transform_columns();
+        }
+    }
+
+    // Potential of a unit mass, softened below one cell
+    void createKernelSpectrum(tp::ThreadPool& thread_pool)
+    {
+        buffer.assign(padded_width * padded_height, 0.0f);
+        twiddles_x = fft::createTwiddles(padded_width);
+        twiddles_y = fft::createTwiddles(padded_height);
+        for (uint32_t y{0}; y < padded_height; ++y) {
+            for (uint32_t x{0}; x < padded_width; ++x) {
+                // Distances wrap around so the kernel is centered on node (0, 0)
+                const auto dx = to<float>(x <= padded_width  / 2 ? x : padded_width  - x);
+                const auto dy = to<float>(y <= padded_height / 2 ? y : padded_height - y);
+                const float dist = std::max(std::sqrt(dx * dx + dy * dy), 1.0f) * cell_size;
+                buffer[y * padded_width + x] = -1.0f / dist;
+            }
+        }
+        transform2D(thread_pool, padded_height, false);
+        kernel_spectrum = buffer;
+    }
+
+    void solvePotential(tp::ThreadPool& thread_pool)
+    {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        for (int32_t y{0}; y < height; ++y) {
+            for (int32_t x{0}; x < width; ++x) {
+                buffer[y * padded_width + x] = density.get(x, y);
+            }
+        }
+        // Rows past the density are zero, so is their transform
+        transform2D(thread_pool, to<uint32_t>(height), false);
+        thread_pool.dispatch(to<uint32_t>(buffer.size()), [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                buffer[i] *= kernel_spectrum[i];
+            }
+        });
+        // Only the first rows are needed
+        transform2D(thread_pool, to<uint32_t>(height), true);
+        const float normalization = 1.0f / to<float>(padded_width * padded_height);
+        for (int32_t y{0}; y < height; ++y) {
+            for (int32_t x{0}; x < width; ++x) {
+                potential.get(x, y) = buffer[y * padded_width + x].real() * normalization;
+            }
+        }
+    }
+
+    // Central differences, one sided on the borders
+    void computeAcceleration(tp::ThreadPool& thread_pool)
+    {
+        const float factor = -strength / cell_size;
+        thread_pool.dispatch(to<uint32_t>(height), [&](uint32_t start, uint32_t end) {
+            for (auto y{to<int32_t>(start)}; y < to<int32_t>(end); ++y) {
+                const int32_t y_0 = std::max(y - 1, 0);
+                const int32_t y_1 = std::min(y + 1, height - 1);
+                for (int32_t x{0}; x < width; ++x) {
+                    const int32_t x_0 = std::max(x - 1, 0);
+                    const int32_t x_1 = std::min(x + 1, width - 1);
+                    const float gx = (potential.get(x_1, y) - potential.get(x_0, y)) / to<float>(std::max(x_1 - x_0, 1));
+                    const float gy = (potential.get(x, y_1) - potential.get(x, y_0)) / to<float>(std::max(y_1 - y_0, 1));
+                    acceleration.get(x, y) = Vec2{gx, gy} * factor;
+                }
+            }
+        });
+    }
+};
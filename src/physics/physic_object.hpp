@@ -6,11 +6,13 @@
 
 struct PhysicObject
 {
+    // Arbitrary, approximating air friction
+    static constexpr float velocity_damping = 40.0f;
+
     // Verlet
     Vec2 position      = {0.0f, 0.0f};
     Vec2 last_position = {0.0f, 0.0f};
     Vec2 acceleration  = {0.0f, 0.0f};
-    sf::Color color;
 
     PhysicObject() = default;
 
@@ -20,6 +22,12 @@ struct PhysicObject
         , last_position(position_)
     {}
 
+    [[nodiscard]]
+    Vec2 getPosition() const
+    {
+        return position;
+    }
+
     void setPosition(Vec2 pos)
     {
         position      = pos;
@@ -29,10 +37,7 @@ struct PhysicObject
     void update(float dt)
     {
         const Vec2 last_update_move = position - last_position;
-
-        const float VELOCITY_DAMPING = 40.0f; // arbitrary, approximating air friction
-
-        const Vec2 new_position = position + last_update_move + (acceleration - last_update_move * VELOCITY_DAMPING) * (dt * dt);
+        const Vec2 new_position     = position + last_update_move + (acceleration - last_update_move * velocity_damping) * (dt * dt);
         last_position           = position;
         position                = new_position;
         acceleration = {0.0f, 0.0f};
@@ -77,3 +82,28 @@ struct PhysicObject
         position += v;
     }
 };
+
+
+// Checks if two objects are colliding and if so moves them apart, returns the penetration (0 if not colliding)
+// When the second object is static (asleep) the first one takes the whole correction
+template<bool TStaticOther, typename TParams>
+inline float resolveContact(PhysicObject& obj_1, PhysicObject& obj_2)
+{
+    constexpr float response_coef = TParams::response_coef;
+    constexpr float eps           = TParams::contact_eps;
+    constexpr float distance      = TParams::contact_distance;
+    constexpr float mass_ratio    = TStaticOther ? 1.0f : 0.5f;
+    const Vec2 o2_o1  = obj_1.position - obj_2.position;
+    const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
+    if (dist2 < distance * distance && dist2 > eps) {
+        const float dist          = sqrt(dist2);
+        const float delta  = response_coef * mass_ratio * (distance - dist);
+        const Vec2 col_vec = (o2_o1 / dist) * delta;
+        obj_1.position += col_vec;
+        if constexpr (!TStaticOther) {
+            obj_2.position -= col_vec;
+        }
+        return distance - dist;
+    }
+    return 0.0f;
+}
@@ -1,175 +1,750 @@
 #pragma once
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
 #include "collision_grid.hpp"
+#include "multi_level_grid.hpp"
+#include "sleep_grid.hpp"
 #include "physic_object.hpp"
+#include "quantized_object.hpp"
+#include "sized_object.hpp"
+#include "solver_policies.hpp"
+#include "integrator.hpp"
+#include "distance_constraints.hpp"
+#include "distance_field.hpp"
+#include "particle_mesh.hpp"
+#include "spatial_query.hpp"
+#include "solver_health.hpp"
+#include "fused_kernels.hpp"
 #include "engine/common/utils.hpp"
 #include "engine/common/index_vector.hpp"
+#include "engine/common/palette.hpp"
+#include "engine/common/perf_counters.hpp"
 #include "thread_pool/thread_pool.hpp"
 
 
-struct PhysicSolver
+// Parts of an update measured by the profiler, see BasicPhysicSolver::setProfiler
+enum class UpdatePhase : uint32_t
 {
-    CIVector<PhysicObject> objects;
-    CollisionGrid          grid;
-    Vec2                   world_size;
-    Vec2                   gravity = {0.0f, 20.0f};
+    Removals,
+    LongRange,
+    Grid,
+    Collisions,
+    Constraints,
+    Integration,
+    Count
+};
+
+inline std::vector<std::string> getUpdatePhaseNames()
+{
+    return {"removals", "long_range", "grid", "collisions", "constraints", "integration"};
+}
+
+
+// Solver configured at compile time, see solver_policies.hpp:
+// - TStorage holds the objects (PhysicObject or QuantizedObject)
+// - TBroadphase is the collision grid, or a multi-level grid for objects of different sizes
+// - TScheduler distributes the collision cells among the threads
+// - TParams holds the constants of the contact and integration code
+template<typename TStorage    = ObjectStorage<PhysicObject>,
+         typename TBroadphase = CollisionGrid,
+         typename TScheduler  = StripeScheduler,
+         typename TParams     = SolverParams>
+struct BasicPhysicSolver
+{
+    using Object     = typename TStorage::Object;
+    using Broadphase = TBroadphase;
+    using Cell       = typename TBroadphase::Cell;
+    using Params     = TParams;
+
+    // Paged by default to avoid relocating all the objects when growing
+    typename TStorage::Vector   objects;
+    // Palette index of each object, indexed like objects.data. Not read by the physics,
+    // kept out of PhysicObject so the solver passes stride over less data
+    civ::PagedArray<ColorIndex> color_indices;
+    TBroadphase                 grid;
+    // Objects the grid did not take during the last sub step (full cell or out of the grid), in index order.
+    // They miss their contacts, the renderers draw them on top of the ones found through the grid
+    mem::Vector<uint32_t, mem::Tag::Grid> dropped_objects;
+    // Links between objects, solved after the contacts
+    DistanceConstraints         constraints;
+    SleepGrid                   sleep_grid;
+    Vec2                        world_size;
+    // Static obstacles, objects are pushed out of them after the integration
+    DistanceField               obstacles;
+    // Long range forces between all the objects, disabled until its strength is set
+    ParticleMesh                long_range;
+    Vec2                        gravity = {0.0f, 20.0f};
+
+    // Sleeping, tiles slower than the threshold (world units per second) for sleep_steps sub steps are frozen
+    bool     sleep_enabled            = false;
+    float    sleep_velocity_threshold = 0.5f;
+    uint32_t sleep_steps              = 64;
+
+    // Set when objects are marked for removal, avoids scanning the flags when nothing has to be removed
+    std::atomic<bool> pending_removals = false;
+
+    // Integration kernel, the best one supported by the CPU by default
+    integrator::Kind integrator_kind = integrator::detect();
 
     // Simulation solving pass count
     uint32_t        sub_steps;
     tp::ThreadPool& thread_pool;
+    // Optional, counters of each update phase
+    perf::PhaseProfiler* profiler = nullptr;
+
+    // Dropped objects and contacts of each sub step of the last update, only filled when health_enabled
+    bool         health_enabled = false;
+    SolverHealth health;
+    uint32_t     health_sub_step = 0;
+    std::mutex   health_mutex;
 
-    PhysicSolver(IVec2 size, tp::ThreadPool& tp)
+    BasicPhysicSolver(IVec2 size, tp::ThreadPool& tp)
         : grid{size.x, size.y}
+        , sleep_grid{size.x, size.y}
         , world_size{to<float>(size.x), to<float>(size.y)}
+        , obstacles{world_size}
+        , long_range{world_size}
         , sub_steps{8}
         , thread_pool{tp}
     {
+        // Fixed point positions overflow beyond fixed::max_world
+        if constexpr (std::is_same_v<Object, QuantizedObject>) {
+            if (to<float>(size.x) > fixed::max_world || to<float>(size.y) > fixed::max_world) {
+                throw std::invalid_argument("Quantized solvers are limited to worlds of fixed::max_world units");
+            }
+        }
         grid.clear();
     }
 
     // Checks if two atoms are colliding and if so create a new contact
-    void solveContact(uint32_t atom_1_idx, uint32_t atom_2_idx)
+    // When the second atom is static (asleep) the first one takes the whole correction.
+    // TStats is ContactStats when the health is tracked, NoContactStats otherwise
+    template<bool TStaticOther = false, typename TStats>
+    void solveContact(uint32_t atom_1_idx, uint32_t atom_2_idx, TStats& stats)
+    {
+        stats.addContact(resolveContact<TStaticOther, TParams>(objects.data[atom_1_idx], objects.data[atom_2_idx]));
+    }
+
+    template<bool TStaticOther = false, typename TStats>
+    void checkAtomCellCollisions(uint32_t atom_idx, const Cell& c, TStats& stats)
     {
-        constexpr float response_coef = 1.0f;
-        constexpr float eps           = 0.0001f;
-        PhysicObject& obj_1 = objects.data[atom_1_idx];
-        PhysicObject& obj_2 = objects.data[atom_2_idx];
-        const Vec2 o2_o1  = obj_1.position - obj_2.position;
-        const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
-        if (dist2 < 1.0f && dist2 > eps) {
-            const float dist          = sqrt(dist2);
-            // Radius are all equal to 1.0f
-            const float delta  = response_coef * 0.5f * (1.0f - dist);
-            const Vec2 col_vec = (o2_o1 / dist) * delta;
-            obj_1.position += col_vec;
-            obj_2.position -= col_vec;
+        for (uint32_t i{0}; i < c.objects_count; ++i) {
+            solveContact<TStaticOther>(atom_idx, c.objects[i], stats);
         }
     }
 
-    void checkAtomCellCollisions(uint32_t atom_idx, const CollisionCell& c)
+    template<typename TCells, typename TStats>
+    void processCell(const TCells& cells, uint32_t index, int32_t x, int32_t y, TStats& stats)
     {
+        const Cell& c = cells.data[index];
+        uint32_t neighbors[9];
+        cells.getStencil(index, x, y, neighbors);
         for (uint32_t i{0}; i < c.objects_count; ++i) {
-            solveContact(atom_idx, c.objects[i]);
+            const uint32_t atom_idx = c.objects[i];
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[0]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[1]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[2]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[3]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[4]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[5]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[6]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[7]], stats);
+            checkAtomCellCollisions(atom_idx, cells.data[neighbors[8]], stats);
         }
     }
 
-    void processCell(const CollisionCell& c, uint32_t index)
+    // Same as processCell but neighbor cells belonging to sleeping tiles act as static obstacles,
+    // this way a settled pile keeps supporting the awake particles resting on it
+    template<typename TStats>
+    void processCellSleep(uint32_t index, int32_t x, int32_t y, TStats& stats)
     {
+        const Cell& c = grid.data[index];
+        uint32_t neighbors[9];
+        grid.getStencil(index, x, y, neighbors);
+        bool static_neighbor[9];
+        for (uint32_t k{0}; k < 9; ++k) {
+            static_neighbor[k] = sleep_grid.isAsleep(x + grid_stencil[k][0], y + grid_stencil[k][1]);
+        }
         for (uint32_t i{0}; i < c.objects_count; ++i) {
             const uint32_t atom_idx = c.objects[i];
-            checkAtomCellCollisions(atom_idx, grid.data[index - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height    ]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height + 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height    ]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height + 1]);
+            for (uint32_t k{0}; k < 9; ++k) {
+                const Cell& other = grid.data[neighbors[k]];
+                if (static_neighbor[k]) {
+                    checkAtomCellCollisions<true>(atom_idx, other, stats);
+                } else {
+                    checkAtomCellCollisions(atom_idx, other, stats);
+                }
+            }
+        }
+    }
+
+    // Cells are processed in memory order, tile by tile with a tiled grid.
+    // Cells belonging to sleeping tiles are skipped
+    template<typename TStats>
+    void solveCollisionThreaded(uint32_t start, uint32_t end, TStats& stats)
+    {
+        if (!sleep_enabled) {
+            grid.forEachCell(start, end, [this, &stats](uint32_t index, int32_t x, int32_t y) {
+                processCell(grid, index, x, y, stats);
+            });
+            return;
         }
+        grid.forEachCell(start, end, [this, &stats](uint32_t index, int32_t x, int32_t y) {
+            if (grid.data[index].objects_count && !sleep_grid.isAsleep(x, y)) {
+                processCellSleep(index, x, y, stats);
+            }
+        });
     }
 
-    void solveCollisionThreaded(uint32_t start, uint32_t end)
+    // Objects of the cell against the objects of the same level around and against the smaller objects close enough,
+    // each pair of levels is solved by the larger one so the stripes given by the scheduler own both objects
+    template<typename TStats>
+    void processLevelCell(uint32_t level_index, uint32_t index, int32_t x, int32_t y, TStats& stats)
     {
-        for (uint32_t idx{start}; idx < end; ++idx) {
-            processCell(grid.data[idx], idx);
+        const auto& cells = grid.levels[level_index].cells;
+        const Cell& c     = cells.data[index];
+        if (!c.objects_count) {
+            return;
+        }
+        processCell(cells, index, x, y, stats);
+        for (uint32_t i{0}; i < c.objects_count; ++i) {
+            const uint32_t atom_idx = c.objects[i];
+            const Object&  atom     = objects.data[atom_idx];
+            for (uint32_t lower_index{0}; lower_index < level_index; ++lower_index) {
+                const auto& lower = grid.levels[lower_index];
+                if (!lower.objects_count) {
+                    continue;
+                }
+                // Smaller objects are at most half a lower cell wide, lower grids have a border of one cell
+                const float   reach = atom.radius + 0.5f * lower.cell_size;
+                const int32_t x_min = std::max(to<int32_t>(std::floor((atom.position.x - reach) * lower.inv_cell_size)) + 1, 0);
+                const int32_t y_min = std::max(to<int32_t>(std::floor((atom.position.y - reach) * lower.inv_cell_size)) + 1, 0);
+                const int32_t x_max = std::min(to<int32_t>(std::floor((atom.position.x + reach) * lower.inv_cell_size)) + 1, lower.cells.width  - 1);
+                const int32_t y_max = std::min(to<int32_t>(std::floor((atom.position.y + reach) * lower.inv_cell_size)) + 1, lower.cells.height - 1);
+                for (int32_t lower_x{x_min}; lower_x <= x_max; ++lower_x) {
+                    for (int32_t lower_y{y_min}; lower_y <= y_max; ++lower_y) {
+                        const Cell& lower_cell = lower.cells.get(lower_x, lower_y);
+                        for (uint32_t k{0}; k < lower_cell.objects_count; ++k) {
+                            solveContact(lower_cell.objects[k], atom_idx, stats);
+                        }
+                    }
+                }
+            }
         }
     }
 
     // Find colliding atoms
     void solveCollisions()
     {
-        // Multi-thread grid
-        const uint32_t thread_count = thread_pool.m_thread_count;
-        const uint32_t slice_count  = thread_count * 2;
-        const uint32_t slice_size   = (grid.width / slice_count) * grid.height;
-        const uint32_t last_cell    = (2 * (thread_count - 1) + 2) * slice_size;
-        // Find collisions in two passes to avoid data races
-
-        // First collision pass
-        for (uint32_t i{0}; i < thread_count; ++i) {
-            thread_pool.addTask([this, i, slice_size]{
-                uint32_t const start{2 * i * slice_size};
-                uint32_t const end  {start + slice_size};
-                solveCollisionThreaded(start, end);
-            });
-        }
-        // Eventually process rest if the world is not divisible by the thread count
-        if (last_cell < grid.data.size()) {
-            thread_pool.addTask([this, last_cell]{
-                solveCollisionThreaded(last_cell, to<uint32_t>(grid.data.size()));
-            });
+        if (health_enabled) {
+            solveCollisions<ContactStats>();
+        } else {
+            solveCollisions<NoContactStats>();
         }
-        thread_pool.waitForCompletion();
-        // Second collision pass
-        for (uint32_t i{0}; i < thread_count; ++i) {
-            thread_pool.addTask([this, i, slice_size]{
-                uint32_t const start{(2 * i + 1) * slice_size};
-                uint32_t const end  {start + slice_size};
-                solveCollisionThreaded(start, end);
-            });
+    }
+
+    // Each range of cells counts its contacts on its own and merges them once done
+    template<typename TStats>
+    void solveCollisions()
+    {
+        const auto solve_range = [this](auto&& solve) {
+            return [this, solve](uint32_t start, uint32_t end) {
+                TStats stats;
+                solve(start, end, stats);
+                if constexpr (std::is_same_v<TStats, ContactStats>) {
+                    const std::lock_guard<std::mutex> lock(health_mutex);
+                    getSubStepHealth().contacts.merge(stats);
+                }
+            };
+        };
+        if constexpr (IsMultiLevelGrid<TBroadphase>::value) {
+            // Levels are solved one after the other, from the smallest objects. Only the used cells are visited
+            for (uint32_t level_index{0}; level_index < TBroadphase::level_count; ++level_index) {
+                const auto& level = grid.levels[level_index];
+                if (!level.objects_count) {
+                    continue;
+                }
+                TScheduler::run(thread_pool, level.cells.getStripesCount(), level.cells.getStripeSize(), solve_range([this, &level, level_index](uint32_t start, uint32_t end, TStats& stats) {
+                    level.forEachUsedCell(start, end, [this, level_index, &stats](uint32_t index, int32_t x, int32_t y) {
+                        processLevelCell(level_index, index, x, y, stats);
+                    });
+                }));
+            }
+        } else {
+            TScheduler::run(thread_pool, grid.getStripesCount(), grid.getStripeSize(), solve_range([this](uint32_t start, uint32_t end, TStats& stats) {
+                solveCollisionThreaded(start, end, stats);
+            }));
         }
-        thread_pool.waitForCompletion();
     }
 
     // Add a new object to the solver
-    uint64_t addObject(const PhysicObject& object)
+    uint64_t addObject(const Object& object, ColorIndex color = 0)
     {
-        return objects.push_back(object);
+        wakeAt(object.getPosition());
+        const uint64_t id = objects.push_back(object);
+        syncColorIndices();
+        color_indices[objects.size() - 1] = color;
+        return id;
     }
 
     // Add a new object to the solver
-    uint64_t createObject(Vec2 pos)
+    uint64_t createObject(Vec2 pos, ColorIndex color = 0)
+    {
+        wakeAt(pos);
+        const uint64_t id = objects.emplace_back(pos);
+        syncColorIndices();
+        color_indices[objects.size() - 1] = color;
+        return id;
+    }
+
+    // Creates count objects at once, initializer(i, id, object) or initializer(i, id, object, color)
+    // is called in parallel for each new object.
+    // The returned range contains the data indices of the new objects
+    template<typename TInitializer>
+    civ::SlotRange createObjects(uint32_t count, TInitializer&& initializer)
+    {
+        const civ::SlotRange range = objects.allocate(count);
+        syncColorIndices();
+        thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                const uint64_t data_index = range.first + i;
+                Object&     obj   = objects.data[data_index];
+                ColorIndex& color = color_indices[data_index];
+                obj   = Object{};
+                color = 0;
+                if constexpr (std::is_invocable_v<TInitializer&, uint32_t, civ::ID, Object&, ColorIndex&>) {
+                    initializer(i, objects.getID(data_index), obj, color);
+                } else {
+                    initializer(i, objects.getID(data_index), obj);
+                }
+            }
+        });
+        if (sleep_enabled) {
+            for (uint64_t i{range.first}; i < range.end(); ++i) {
+                sleep_grid.wake(objects.data[i].getPosition());
+            }
+        }
+        return range;
+    }
+
+    // Creates one object per position, velocities and colors are optional
+    civ::SlotRange createObjects(const std::vector<Vec2>& positions,
+                                 const std::vector<Vec2>& velocities = {},
+                                 const std::vector<ColorIndex>& colors = {})
+    {
+        return createObjects(to<uint32_t>(positions.size()), [&](uint32_t i, civ::ID, Object& obj, ColorIndex& color) {
+            obj.setPosition(positions[i]);
+            if (i < velocities.size()) {
+                obj.addVelocity(velocities[i]);
+            }
+            if (i < colors.size()) {
+                color = colors[i];
+            }
+        });
+    }
+
+    // Marks an object for removal, it is safe to call it from the solver's threads for different objects.
+    // Objects are actually removed at the beginning of the next update
+    void removeObject(civ::ID id)
+    {
+        removeObjectAt(objects.getDataID(id));
+    }
+
+    void removeObjectAt(uint64_t data_index)
+    {
+        objects.markForRemovalAt(data_index);
+        pending_removals.store(true, std::memory_order_relaxed);
+    }
+
+    // Removes an object right away, the last object takes its data index. Each call scans the links,
+    // removeObject and flushRemovals are faster to remove many objects
+    void eraseObject(civ::ID id)
+    {
+        const uint64_t data_index = objects.getDataID(id);
+        if (data_index >= objects.size()) {
+            return;
+        }
+        if (sleep_enabled) {
+            sleep_grid.wake(objects.data[data_index].getPosition());
+        }
+        const uint64_t last_index = objects.size() - 1;
+        objects.erase(id);
+        color_indices[data_index] = color_indices[last_index];
+        syncColorIndices();
+        constraints.eraseObject(to<uint32_t>(data_index), to<uint32_t>(last_index));
+    }
+
+    // Removes all the marked objects in a single parallel pass, the returned remap gives the
+    // new data index of each object (civ::InvalidIndex if removed), it is empty if nothing changed.
+    // The grid holds data indices and is only valid again after the next addObjectsToGrid
+    const std::vector<uint64_t>& flushRemovals()
+    {
+        static const std::vector<uint64_t> no_remap;
+        if (!pending_removals.exchange(false)) {
+            return no_remap;
+        }
+        if (sleep_enabled) {
+            // Objects resting on the removed ones have to fall
+            const uint64_t count = objects.size();
+            for (uint64_t i{0}; i < count; ++i) {
+                if (objects.removal_flags[i]) {
+                    sleep_grid.wake(objects.data[i].getPosition());
+                }
+            }
+        }
+        const std::vector<uint64_t>& remap = objects.compact([this](uint32_t count, auto&& callback) {
+            thread_pool.dispatch(count, callback);
+        });
+        // Objects moved from the tail to the holes, their colors follow
+        const uint64_t new_size = objects.size();
+        const auto     old_size = to<uint32_t>(remap.size());
+        thread_pool.dispatch(old_size - to<uint32_t>(std::min<uint64_t>(new_size, old_size)), [&](uint32_t start, uint32_t end) {
+            for (uint64_t i{new_size + start}; i < new_size + end; ++i) {
+                if (remap[i] != civ::InvalidIndex) {
+                    color_indices[remap[i]] = color_indices[i];
+                }
+            }
+        });
+        syncColorIndices();
+        constraints.remap(remap);
+        return remap;
+    }
+
+    // The colors stream is kept aligned by the solver's creation and removal functions,
+    // this only restores its size if objects were added or erased directly
+    void syncColorIndices()
+    {
+        if (color_indices.size() != objects.size()) {
+            color_indices.resize(objects.size());
+        }
+    }
+
+    [[nodiscard]]
+    ColorIndex getColorIndex(uint64_t data_index) const
+    {
+        return data_index < color_indices.size() ? color_indices[data_index] : 0;
+    }
+
+    // Links two objects at their current distance
+    void addLink(civ::ID id_1, civ::ID id_2, float stiffness = 1.0f)
+    {
+        const uint64_t index_1 = objects.getDataID(id_1);
+        const uint64_t index_2 = objects.getDataID(id_2);
+        const float    length  = MathVec2::length(objects.data[index_1].getPosition() - objects.data[index_2].getPosition());
+        constraints.add(to<uint32_t>(index_1), to<uint32_t>(index_2), length, stiffness);
+    }
+
+    // Spatial queries on the grid of the last sub step, see spatial_query.hpp. Results are written in out
+    IDSpan queryRadius(Vec2 center, float radius, civ::ID* out, uint32_t capacity) const
+    {
+        return query::radius(*this, center, radius, out, capacity);
+    }
+
+    IDSpan queryBox(Vec2 min, Vec2 max, civ::ID* out, uint32_t capacity) const
     {
-        return objects.emplace_back(pos);
+        return query::box(*this, min, max, out, capacity);
     }
 
-    void update(float dt)
+    // out has to hold k IDs
+    IDSpan queryNearest(Vec2 center, uint32_t k, float max_radius, civ::ID* out) const
     {
+        return query::nearest(*this, center, k, max_radius, out);
+    }
+
+    // Query i writes in out[i * capacity, (i + 1) * capacity), must not be called during an update
+    void queryRadiusBatch(const Vec2* centers, uint32_t count, float radius, civ::ID* out, uint32_t capacity, IDSpan* results) const
+    {
+        query::radiusBatch(*this, thread_pool, centers, count, radius, out, capacity, results);
+    }
+
+    // New objects might be created at rest in a sleeping tile
+    void wakeAt(Vec2 position)
+    {
+        if (sleep_enabled) {
+            sleep_grid.wake(position);
+        }
+    }
+
+    // kernels are per object callables fused into the integration pass, see fused_kernels.hpp
+    template<typename... TKernels>
+    void update(float dt, TKernels&&... kernels)
+    {
+        {
+            // Safe point, the grid is rebuilt right after
+            const auto scope = profile(UpdatePhase::Removals);
+            flushRemovals();
+            syncColorIndices();
+        }
+        // The long range forces change slowly, they are computed once for all the sub steps
+        if (long_range.isEnabled()) {
+            const auto scope = profile(UpdatePhase::LongRange);
+            long_range.update(thread_pool, objects);
+        }
+        if (health_enabled) {
+            health.reset(sub_steps);
+        }
         // Perform the sub steps
         const float sub_dt = dt / static_cast<float>(sub_steps);
         for (uint32_t i(sub_steps); i--;) {
-            addObjectsToGrid();
-            solveCollisions();
-            updateObjects_multi(sub_dt);
+            health_sub_step = sub_steps - 1 - i;
+            {
+                const auto scope = profile(UpdatePhase::Grid);
+                addObjectsToGrid();
+                if (sleep_enabled) {
+                    const float motion_threshold = sleep_velocity_threshold * sub_dt;
+                    sleep_grid.update(motion_threshold * motion_threshold, sleep_steps);
+                }
+            }
+            {
+                const auto scope = profile(UpdatePhase::Collisions);
+                solveCollisions();
+            }
+            {
+                const auto scope = profile(UpdatePhase::Constraints);
+                if (sleep_enabled) {
+                    constraints.solve(thread_pool, objects, sleep_velocity_threshold * sub_dt);
+                    wakeMovingLinks();
+                } else {
+                    constraints.solve(thread_pool, objects);
+                }
+            }
+            const auto scope = profile(UpdatePhase::Integration);
+            updateObjects_multi(sub_dt, kernels...);
+        }
+    }
+
+    // The profiler gets the counters of the thread pool's tasks, it has one phase per UpdatePhase.
+    // nullptr disables the profiling
+    void setProfiler(perf::PhaseProfiler* phase_profiler)
+    {
+        profiler = phase_profiler;
+        thread_pool.setTaskObserver(phase_profiler);
+    }
+
+    [[nodiscard]]
+    perf::PhaseScope profile(UpdatePhase phase)
+    {
+        return {profiler, to<uint32_t>(phase)};
+    }
+
+    // Counts the objects left out of the collision pass and the contacts of each sub step, see solver_health.hpp.
+    // The contacts are counted by a separate instantiation of the collision pass, disabled it costs nothing
+    void setHealthEnabled(bool enabled)
+    {
+        health_enabled = enabled;
+        health.reset(0);
+    }
+
+    // Sub steps of the last update
+    [[nodiscard]]
+    const SolverHealth& getHealth() const
+    {
+        return health;
+    }
+
+    // The grid and the collision pass can also be run outside of an update
+    SubStepHealth& getSubStepHealth()
+    {
+        if (health_sub_step >= health.sub_steps.size()) {
+            health.sub_steps.resize(health_sub_step + 1);
+        }
+        return health.sub_steps[health_sub_step];
+    }
+
+    // The multi-level grid does not support sleeping
+    void setSleepEnabled(bool enabled)
+    {
+        sleep_enabled = enabled && !IsMultiLevelGrid<TBroadphase>::value;
+        sleep_grid.wakeAll();
+    }
+
+    // Links pulling on objects of a sleeping tile wake it, otherwise its objects would be stopped
+    // when added to the grid and lose the correction
+    void wakeMovingLinks()
+    {
+        for (uint32_t i{0}; i < constraints.moving.size(); ++i) {
+            if (constraints.moving[i]) {
+                sleep_grid.wake(objects.data[constraints.first[i]].getPosition());
+                sleep_grid.wake(objects.data[constraints.second[i]].getPosition());
+            }
         }
     }
 
     void addObjectsToGrid()
     {
         grid.clear();
-        // Safety border to avoid adding object outside the grid
+        dropped_objects.clear();
+        // Objects the grid did not take, always counted as it costs a single add per object
+        uint32_t overflows{0};
+        uint32_t out_of_bounds{0};
+        if constexpr (IsMultiLevelGrid<TBroadphase>::value) {
+            addObjectsToLevels(overflows, out_of_bounds);
+        } else {
+            // Safety border to avoid adding object outside the grid
+            uint32_t i{0};
+            for (Object& obj : objects) {
+                const Vec2 position = obj.getPosition();
+                if (position.x > 1.0f && position.x < world_size.x - 1.0f &&
+                    position.y > 1.0f && position.y < world_size.y - 1.0f) {
+                    const int32_t x = to<int32_t>(position.x);
+                    const int32_t y = to<int32_t>(position.y);
+                    if (!grid.addAtom(x, y, i)) {
+                        ++overflows;
+                        dropped_objects.push_back(i);
+                    }
+                    if (sleep_enabled) {
+                        sleep_grid.reportMotion(x, y, MathVec2::length2(obj.getVelocity()));
+                        // Sleeping objects are static, make sure they don't carry any velocity when woken up
+                        if (sleep_grid.isAsleep(x, y)) {
+                            obj.stop();
+                        }
+                    }
+                } else {
+                    ++out_of_bounds;
+                    dropped_objects.push_back(i);
+                }
+                ++i;
+            }
+        }
+        if (health_enabled) {
+            SubStepHealth& sub_step = getSubStepHealth();
+            sub_step.cell_overflows = overflows;
+            sub_step.out_of_bounds  = out_of_bounds;
+        }
+    }
+
+    // Each object goes in the level matching its size
+    void addObjectsToLevels(uint32_t& overflows, uint32_t& out_of_bounds)
+    {
         uint32_t i{0};
-        for (const PhysicObject& obj : objects.data) {
-            if (obj.position.x > 1.0f && obj.position.x < world_size.x - 1.0f &&
-                obj.position.y > 1.0f && obj.position.y < world_size.y - 1.0f) {
-                grid.addAtom(to<int32_t>(obj.position.x), to<int32_t>(obj.position.y), i);
+        for (Object& obj : objects) {
+            const Vec2 position = obj.getPosition();
+            if (position.x >= 0.0f && position.x < world_size.x &&
+                position.y >= 0.0f && position.y < world_size.y) {
+                if (!grid.addAtom(position, obj.radius, i)) {
+                    ++overflows;
+                    dropped_objects.push_back(i);
+                }
+            } else {
+                ++out_of_bounds;
+                dropped_objects.push_back(i);
             }
             ++i;
         }
     }
 
-    void updateObjects_multi(float dt)
+    [[nodiscard]]
+    integrator::Parameters getIntegrationParameters(float dt) const
     {
-        thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end){
-            for (uint32_t i{start}; i < end; ++i) {
-                PhysicObject& obj = objects.data[i];
-                // Add gravity
-                obj.acceleration += gravity;
-                // Apply Verlet integration
-                obj.update(dt);
-                // Apply map borders collisions
-                const float margin = 2.0f;
-                if (obj.position.x > world_size.x - margin) {
-                    obj.position.x = world_size.x - margin;
-                } else if (obj.position.x < margin) {
-                    obj.position.x = margin;
-                }
-                if (obj.position.y > world_size.y - margin) {
-                    obj.position.y = world_size.y - margin;
-                } else if (obj.position.y < margin) {
-                    obj.position.y = margin;
+        // Map borders
+        const float margin = TParams::border_margin;
+        return {gravity, dt, TParams::velocity_damping, {margin, margin}, {world_size.x - margin, world_size.y - margin}};
+    }
+
+    void applyLongRangeForces(Object* run, uint64_t count, float dt) const
+    {
+        for (uint64_t i{0}; i < count; ++i) {
+            const Vec2 acceleration = long_range.getAcceleration(run[i].getPosition());
+            if constexpr (std::is_base_of_v<PhysicObject, Object>) {
+                run[i].acceleration += acceleration;
+            } else {
+                // No acceleration to accumulate into, same displacement as the integration would give
+                run[i].addVelocity(acceleration * (dt * dt));
+            }
+        }
+    }
+
+    // Pushes the objects overlapping an obstacle out along the distance gradient
+    void resolveObstacles(Object* run, uint64_t count) const
+    {
+        for (uint64_t i{0}; i < count; ++i) {
+            Object& obj = run[i];
+            float radius = 0.5f * TParams::contact_distance;
+            if constexpr (std::is_same_v<Object, SizedObject>) {
+                radius = obj.radius;
+            }
+            const DistanceField::Sample sample = obstacles.sample(obj.getPosition());
+            const float penetration = radius - sample.distance;
+            if (penetration > 0.0f) {
+                const float gradient_length = MathVec2::length(sample.gradient);
+                if (gradient_length > 0.0f) {
+                    obj.move(sample.gradient * (penetration / gradient_length));
                 }
             }
+        }
+    }
+
+    template<typename... TKernels>
+    void updateObjects_multi(float dt, TKernels&... kernels)
+    {
+        const integrator::Parameters params = getIntegrationParameters(dt);
+        // The quantized objects have a single kernel
+        void (*kernel)(Object*, uint32_t, const integrator::Parameters&) = nullptr;
+        if constexpr (std::is_same_v<Object, QuantizedObject>) {
+            kernel = integrator::integrateQuantized;
+        } else {
+            kernel = integrator::getKernel<Object>(integrator_kind);
+        }
+        // Objects [first, first + count) stored contiguously from run
+        const bool has_obstacles  = !obstacles.empty();
+        const bool has_long_range = long_range.isEnabled();
+        const auto integrate = [&](Object* run, uint64_t first, uint64_t count) {
+            if (has_long_range) {
+                applyLongRangeForces(run, count, dt);
+            }
+            if constexpr (sizeof...(TKernels) == 0) {
+                kernel(run, to<uint32_t>(count), params);
+                if (has_obstacles) {
+                    resolveObstacles(run, count);
+                }
+            } else {
+                for (uint64_t block{0}; block < count; block += fused::block_size) {
+                    const uint64_t block_end = std::min(block + fused::block_size, count);
+                    for (uint64_t i{block}; i < block_end; ++i) {
+                        (fused::applyPre(kernels, first + i, run[i], dt), ...);
+                    }
+                    kernel(run + block, to<uint32_t>(block_end - block), params);
+                    if (has_obstacles) {
+                        resolveObstacles(run + block, block_end - block);
+                    }
+                    for (uint64_t i{block}; i < block_end; ++i) {
+                        (fused::applyPost(kernels, first + i, run[i], dt), ...);
+                    }
+                }
+            }
+        };
+        thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end){
+            uint64_t run_first = start;
+            civ::foreachRun(objects.data, start, end, [&](Object* run, uint64_t count) {
+                const uint64_t first = run_first;
+                run_first += count;
+                if (!sleep_enabled) {
+                    integrate(run, first, count);
+                    return;
+                }
+                // Sleeping objects are frozen until the motion of a neighbor tile wakes them up,
+                // integrate the runs of awake objects
+                uint64_t i{0};
+                while (i < count) {
+                    while (i < count && sleep_grid.isAsleep(run[i].getPosition())) {
+                        ++i;
+                    }
+                    const uint64_t awake_start = i;
+                    while (i < count && !sleep_grid.isAsleep(run[i].getPosition())) {
+                        ++i;
+                    }
+                    integrate(run + awake_start, first + awake_start, i - awake_start);
+                }
+            });
         });
     }
 };
+
+
+using PhysicSolver = BasicPhysicSolver<>;
+// Reduces the memory streamed by the solver passes, see QuantizedObject
+using QuantizedPhysicSolver = BasicPhysicSolver<ObjectStorage<QuantizedObject>>;
+// Objects with their own radius and mass, see SizedObject and BasicMultiLevelGrid
+using PolydisperseSolver = BasicPhysicSolver<ObjectStorage<SizedObject>, MultiLevelGrid>;
@@ -0,0 +1,168 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "physic_object.hpp"
+#include "integrator.hpp"
+
+
+// Fixed point coordinates with 20 fractional bits: worlds up to 2048 units wide with a resolution
+// of about 1e-6 units, better than a float close to the world's far border.
+namespace fixed
+{
+
+constexpr int32_t frac_bits = 20;
+constexpr float   scale     = static_cast<float>(1 << frac_bits);
+constexpr float   max_world = static_cast<float>(1 << (31 - frac_bits));
+
+inline int32_t fromFloat(float value)
+{
+    return static_cast<int32_t>(std::lrint(value * scale));
+}
+
+inline float toFloat(int32_t value)
+{
+    return static_cast<float>(value) / scale;
+}
+
+}
+
+
+struct FixedVec2
+{
+    int32_t x = 0;
+    int32_t y = 0;
+
+    FixedVec2() = default;
+
+    FixedVec2(int32_t x_, int32_t y_)
+        : x{x_}
+        , y{y_}
+    {}
+
+    explicit
+    FixedVec2(Vec2 v)
+        : x{fixed::fromFloat(v.x)}
+        , y{fixed::fromFloat(v.y)}
+    {}
+
+    [[nodiscard]]
+    Vec2 toFloat() const
+    {
+        return {fixed::toFloat(x), fixed::toFloat(y)};
+    }
+};
+
+
+// Same object as PhysicObject with fixed point positions and without acceleration (gravity is the
+// only acceleration the solver applies): 16 bytes instead of 24
+struct QuantizedObject
+{
+    static constexpr float velocity_damping = PhysicObject::velocity_damping;
+
+    FixedVec2 position;
+    FixedVec2 last_position;
+
+    QuantizedObject() = default;
+
+    explicit
+    QuantizedObject(Vec2 position_)
+        : position{position_}
+        , last_position{position_}
+    {}
+
+    [[nodiscard]]
+    Vec2 getPosition() const
+    {
+        return position.toFloat();
+    }
+
+    void setPosition(Vec2 pos)
+    {
+        position      = FixedVec2{pos};
+        last_position = position;
+    }
+
+    void stop()
+    {
+        last_position = position;
+    }
+
+    [[nodiscard]]
+    Vec2 getVelocity() const
+    {
+        return FixedVec2{position.x - last_position.x, position.y - last_position.y}.toFloat();
+    }
+
+    void addVelocity(Vec2 v)
+    {
+        const FixedVec2 velocity{v};
+        last_position.x -= velocity.x;
+        last_position.y -= velocity.y;
+    }
+
+    void move(Vec2 v)
+    {
+        const FixedVec2 offset{v};
+        position.x += offset.x;
+        position.y += offset.y;
+    }
+};
+
+
+// Same as the float contact, the distance test is done on integers
+template<bool TStaticOther, typename TParams>
+inline float resolveContact(QuantizedObject& obj_1, QuantizedObject& obj_2)
+{
+    constexpr float   response_coef = TParams::response_coef;
+    constexpr float   mass_ratio    = TStaticOther ? 1.0f : 0.5f;
+    constexpr auto    distance      = static_cast<int64_t>(TParams::contact_distance * fixed::scale);
+    constexpr int64_t distance2     = distance * distance;
+    constexpr auto    eps2          = static_cast<int64_t>(TParams::contact_eps * fixed::scale * fixed::scale);
+    const int32_t dx = obj_1.position.x - obj_2.position.x;
+    const int32_t dy = obj_1.position.y - obj_2.position.y;
+    const int64_t dist2 = int64_t{dx} * dx + int64_t{dy} * dy;
+    if (dist2 < distance2 && dist2 > eps2) {
+        // The correction is (o2_o1 / dist) * (distance - dist) in fixed point
+        const float dist   = std::sqrt(static_cast<float>(dist2));
+        const float factor = response_coef * mass_ratio * (static_cast<float>(distance) / dist - 1.0f);
+        // Truncation, the bias is below the fixed point resolution
+        const auto  col_x  = static_cast<int32_t>(static_cast<float>(dx) * factor);
+        const auto  col_y  = static_cast<int32_t>(static_cast<float>(dy) * factor);
+        obj_1.position.x += col_x;
+        obj_1.position.y += col_y;
+        if constexpr (!TStaticOther) {
+            obj_2.position.x -= col_x;
+            obj_2.position.y -= col_y;
+        }
+        return (static_cast<float>(distance) - dist) / fixed::scale;
+    }
+    return 0.0f;
+}
+
+
+namespace integrator
+{
+
+// Fixed point Verlet step, only gravity is applied
+inline void integrateQuantized(QuantizedObject* objects, uint32_t count, const Parameters& params)
+{
+    const float dt2 = params.dt * params.dt;
+    const FixedVec2 gravity{params.gravity * dt2};
+    // The damping factor is small (damping * dt2), it is kept with 30 fractional bits
+    const auto    damping = static_cast<int64_t>(std::llrint(static_cast<double>(params.damping * dt2) * static_cast<double>(int64_t{1} << 30)));
+    const FixedVec2 min_position{params.min_position};
+    const FixedVec2 max_position{params.max_position};
+    for (uint32_t i{0}; i < count; ++i) {
+        QuantizedObject& obj = objects[i];
+        const int32_t move_x = obj.position.x - obj.last_position.x;
+        const int32_t move_y = obj.position.y - obj.last_position.y;
+        const int32_t new_x  = obj.position.x + move_x + gravity.x - static_cast<int32_t>((move_x * damping) >> 30);
+        const int32_t new_y  = obj.position.y + move_y + gravity.y - static_cast<int32_t>((move_y * damping) >> 30);
+        obj.last_position = obj.position;
+        obj.position.x    = std::min(std::max(new_x, min_position.x), max_position.x);
+        obj.position.y    = std::min(std::max(new_y, min_position.y), max_position.y);
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "physic_object.hpp"
+
+
+// PhysicObject with its own radius and mass, for materials mixing objects of different sizes.
+// It is 32 bytes instead of 24 so only the solvers configured with it pay for it, see PolydisperseSolver
+struct SizedObject : public PhysicObject
+{
+    float radius       = 0.5f;
+    float inverse_mass = 1.0f;
+
+    SizedObject() = default;
+
+    explicit
+    SizedObject(Vec2 position_, float radius_ = 0.5f)
+        : PhysicObject(position_)
+    {
+        setRadius(radius_);
+    }
+
+    // The mass follows the area, an object of radius 0.5 and density 1 weighs 1
+    void setRadius(float r, float density = 1.0f)
+    {
+        radius = r;
+        setMass(density * 4.0f * r * r);
+    }
+
+    void setMass(float mass)
+    {
+        inverse_mass = 1.0f / mass;
+    }
+
+    [[nodiscard]]
+    float getMass() const
+    {
+        return 1.0f / inverse_mass;
+    }
+};
+
+
+// Same as the PhysicObject version, the correction is shared according to the masses
+template<bool TStaticOther, typename TParams>
+inline float resolveContact(SizedObject& obj_1, SizedObject& obj_2)
+{
+    constexpr float response_coef = TParams::response_coef;
+    constexpr float eps           = TParams::contact_eps;
+    const float distance = obj_1.radius + obj_2.radius;
+    const Vec2 o2_o1  = obj_1.position - obj_2.position;
+    const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
+    if (dist2 < distance * distance && dist2 > eps) {
+        const float dist       = sqrt(dist2);
+        const float mass_ratio = TStaticOther ? 1.0f : obj_1.inverse_mass / (obj_1.inverse_mass + obj_2.inverse_mass);
+        const Vec2 col_vec     = (o2_o1 / dist) * (response_coef * (distance - dist));
+        obj_1.position += col_vec * mass_ratio;
+        if constexpr (!TStaticOther) {
+            obj_2.position -= col_vec * (1.0f - mass_ratio);
+        }
+        return distance - dist;
+    }
+    return 0.0f;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include "engine/common/grid.hpp"
+
+
+struct SleepTile
+{
+    // Squared displacements of the tile's particles accumulated during the current sub step
+    float    motion_sum   = 0.0f;
+    uint32_t motion_count = 0;
+    uint32_t calm_steps   = 0;
+    bool     moving       = false;
+    bool     asleep       = false;
+};
+
+
+// Coarse grid covering the collision grid with tiles of tile_size x tile_size cells.
+// Tiles whose particles stayed slow long enough are put to sleep, they are then skipped
+// by the integration and the collision passes until something moves in their neighborhood.
+struct SleepGrid : public Grid<SleepTile>
+{
+    static constexpr int32_t tile_size_log = 3;
+    static constexpr int32_t tile_size     = 1 << tile_size_log;
+
+    SleepGrid()
+        : Grid<SleepTile>()
+    {}
+
+    SleepGrid(int32_t cells_width, int32_t cells_height)
+        : Grid<SleepTile>((cells_width + tile_size - 1) >> tile_size_log, (cells_height + tile_size - 1) >> tile_size_log)
+    {}
+
+    [[nodiscard]]
+    bool isAsleep(int32_t cell_x, int32_t cell_y) const
+    {
+        return getTile(cell_x, cell_y).asleep;
+    }
+
+    template<typename Vec2Type>
+    [[nodiscard]]
+    bool isAsleep(const Vec2Type& position) const
+    {
+        return isAsleep(static_cast<int32_t>(position.x), static_cast<int32_t>(position.y));
+    }
+
+    void reportMotion(int32_t cell_x, int32_t cell_y, float motion2)
+    {
+        SleepTile& tile = getTile(cell_x, cell_y);
+        tile.motion_sum += motion2;
+        ++tile.motion_count;
+    }
+
+    // Updates tiles states from the motion reported since the last call, a tile is moving when the
+    // mean squared displacement of its particles exceeds the threshold (a few jittering particles
+    // in a settled pile should not keep it awake).
+    // A tile falls asleep when itself and its 8 neighbors have been calm for steps_to_sleep sub steps,
+    // this way any motion wakes the surrounding tiles and the activity propagates through the grid.
+    void update(float motion_threshold2, uint32_t steps_to_sleep)
+    {
+        for (SleepTile& tile : data) {
+            tile.moving       = tile.motion_sum > motion_threshold2 * static_cast<float>(tile.motion_count);
+            tile.motion_sum   = 0.0f;
+            tile.motion_count = 0;
+        }
+
+        for (int32_t x{0}; x < width; ++x) {
+            for (int32_t y{0}; y < height; ++y) {
+                SleepTile& tile = get(x, y);
+                if (isNeighborhoodMoving(x, y)) {
+                    tile.calm_steps = 0;
+                    tile.asleep     = false;
+                } else {
+                    tile.calm_steps = std::min(tile.calm_steps + 1, steps_to_sleep);
+                    tile.asleep     = tile.calm_steps >= steps_to_sleep;
+                }
+            }
+        }
+    }
+
+    // Wakes the tile up, it will not sleep again before steps_to_sleep calm sub steps
+    void wake(int32_t cell_x, int32_t cell_y)
+    {
+        SleepTile& tile = getTile(cell_x, cell_y);
+        tile.calm_steps = 0;
+        tile.asleep     = false;
+    }
+
+    template<typename Vec2Type>
+    void wake(const Vec2Type& position)
+    {
+        wake(static_cast<int32_t>(position.x), static_cast<int32_t>(position.y));
+    }
+
+    void wakeAll()
+    {
+        for (SleepTile& tile : data) {
+            tile = SleepTile{};
+        }
+    }
+
+    [[nodiscard]]
+    uint32_t getAsleepCount() const
+    {
+        return static_cast<uint32_t>(std::count_if(data.begin(), data.end(), [](const SleepTile& t) { return t.asleep; }));
+    }
+
+private:
+    [[nodiscard]]
+    const SleepTile& getTile(int32_t cell_x, int32_t cell_y) const
+    {
+        const int32_t x = std::clamp(cell_x >> tile_size_log, 0, width - 1);
+        const int32_t y = std::clamp(cell_y >> tile_size_log, 0, height - 1);
+        return get(x, y);
+    }
+
+    SleepTile& getTile(int32_t cell_x, int32_t cell_y)
+    {
+        return const_cast<SleepTile&>(static_cast<const SleepGrid*>(this)->getTile(cell_x, cell_y));
+    }
+
+    [[nodiscard]]
+    bool isNeighborhoodMoving(int32_t x, int32_t y) const
+    {
+        const int32_t x_min = std::max(x - 1, 0);
+        const int32_t x_max = std::min(x + 1, width - 1);
+        const int32_t y_min = std::max(y - 1, 0);
+        const int32_t y_max = std::min(y + 1, height - 1);
+        for (int32_t nx{x_min}; nx <= x_max; ++nx) {
+            for (int32_t ny{y_min}; ny <= y_max; ++ny) {
+                if (get(nx, ny).moving) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
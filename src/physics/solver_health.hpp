@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+// Contacts of a part of the collision pass, each thread fills its own then merges it
+struct ContactStats
+{
+    uint64_t tested          = 0;
+    uint64_t resolved        = 0;
+    double   penetration_sum = 0.0;
+    float    max_penetration = 0.0f;
+
+    // penetration is 0 if the objects were not touching
+    void addContact(float penetration)
+    {
+        ++tested;
+        if (penetration > 0.0f) {
+            ++resolved;
+            penetration_sum += penetration;
+            max_penetration  = std::max(max_penetration, penetration);
+        }
+    }
+
+    void merge(const ContactStats& other)
+    {
+        tested          += other.tested;
+        resolved        += other.resolved;
+        penetration_sum += other.penetration_sum;
+        max_penetration  = std::max(max_penetration, other.max_penetration);
+    }
+};
+
+// Used when the health is not tracked, compiles to nothing
+struct NoContactStats
+{
+    void addContact(float) {}
+    void merge(const NoContactStats&) {}
+};
+
+
+// What the solver silently gave up during a sub step, and how well the contacts were solved
+struct SubStepHealth
+{
+    // Objects not added to the grid because their cell was full, they miss all their contacts
+    uint32_t     cell_overflows = 0;
+    // Objects not added to the grid because they were out of it
+    uint32_t     out_of_bounds  = 0;
+    ContactStats contacts;
+
+    // Penetration found by the collision pass, before the correction
+    [[nodiscard]]
+    float getMeanPenetration() const
+    {
+        return contacts.resolved ? static_cast<float>(contacts.penetration_sum / static_cast<double>(contacts.resolved)) : 0.0f;
+    }
+};
+
+// Health of the sub steps of the last update, see BasicPhysicSolver::setHealthEnabled
+struct SolverHealth
+{
+    std::vector<SubStepHealth> sub_steps;
+
+    void reset(uint32_t sub_steps_count)
+    {
+        sub_steps.assign(sub_steps_count, SubStepHealth{});
+    }
+
+    // Sum over the sub steps, the max penetration is the one of the worst sub step
+    [[nodiscard]]
+    SubStepHealth getTotal() const
+    {
+        SubStepHealth total;
+        for (const SubStepHealth& sub_step : sub_steps) {
+            total.cell_overflows += sub_step.cell_overflows;
+            total.out_of_bounds  += sub_step.out_of_bounds;
+            total.contacts.merge(sub_step.contacts);
+        }
+        return total;
+    }
+
+    // True if objects were left out of the collision pass
+    [[nodiscard]]
+    bool hasDroppedObjects() const
+    {
+        const SubStepHealth total = getTotal();
+        return total.cell_overflows || total.out_of_bounds;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include "physic_object.hpp"
+#include "engine/common/index_vector.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+// Compile-time configuration of BasicPhysicSolver. Each policy can be replaced independently,
+// the default ones give the original solver.
+
+// Storage: type of the objects and of the container holding them
+template<typename TObject, template<typename> class TContainerStorage = civ::PagedStorage>
+struct ObjectStorage
+{
+    using Object = TObject;
+    using Vector = civ::Vector<TObject, TContainerStorage>;
+};
+
+
+// Constants folded into the contact and integration code
+struct SolverParams
+{
+    // Distance between the centers of two touching objects, all objects have the same radius (SizedObject uses its radius)
+    static constexpr float contact_distance = 1.0f;
+    static constexpr float response_coef    = 1.0f;
+    // Squared distance below which two objects are considered at the same position
+    static constexpr float contact_eps      = 0.0001f;
+    static constexpr float velocity_damping = PhysicObject::velocity_damping;
+    // Objects are kept this far from the world's borders
+    static constexpr float border_margin    = 2.0f;
+};
+
+
+// Scheduler: distributes the collision grid cells among the threads, solve_range(start, end)
+// processes the cells in [start, end) and reads and writes objects of the neighbor stripes.
+// The grid's data is made of stripes_count stripes of stripe_size cells (columns, or columns of tiles).
+
+// Slices of whole stripes solved in two passes, slices of a pass are never adjacent
+struct StripeScheduler
+{
+    template<typename TCallback>
+    static void run(tp::ThreadPool& thread_pool, int32_t stripes_count, int32_t stripe_size, TCallback&& solve_range)
+    {
+        const uint32_t thread_count = thread_pool.m_thread_count;
+        const uint32_t slice_count  = thread_count * 2;
+        const uint32_t slice_size   = (stripes_count / slice_count) * stripe_size;
+        const uint32_t last_cell    = (2 * (thread_count - 1) + 2) * slice_size;
+        const auto     cells_count  = to<uint32_t>(stripes_count * stripe_size);
+        // Find collisions in two passes to avoid data races
+
+        // First collision pass
+        for (uint32_t i{0}; i < thread_count; ++i) {
+            thread_pool.addTask([&solve_range, i, slice_size]{
+                uint32_t const start{2 * i * slice_size};
+                uint32_t const end  {start + slice_size};
+                solve_range(start, end);
+            });
+        }
+        // Eventually process rest if the world is not divisible by the thread count
+        if (last_cell < cells_count) {
+            thread_pool.addTask([&solve_range, last_cell, cells_count]{
+                solve_range(last_cell, cells_count);
+            });
+        }
+        thread_pool.waitForCompletion();
+        // Second collision pass
+        for (uint32_t i{0}; i < thread_count; ++i) {
+            thread_pool.addTask([&solve_range, i, slice_size]{
+                uint32_t const start{(2 * i + 1) * slice_size};
+                uint32_t const end  {start + slice_size};
+                solve_range(start, end);
+            });
+        }
+        thread_pool.waitForCompletion();
+    }
+};
+
+// All the cells in order on the calling thread, for small worlds or deterministic runs
+struct SerialScheduler
+{
+    template<typename TCallback>
+    static void run(tp::ThreadPool&, int32_t stripes_count, int32_t stripe_size, TCallback&& solve_range)
+    {
+        solve_range(0, to<uint32_t>(stripes_count * stripe_size));
+    }
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include "multi_level_grid.hpp"
+#include "engine/common/index_vector.hpp"
+#include "engine/common/math.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+// IDs written by a query in a buffer owned by the caller
+struct IDSpan
+{
+    civ::ID* data  = nullptr;
+    uint32_t count = 0;
+    // Number of matching objects, larger than count if the buffer was too small
+    uint32_t found = 0;
+
+    [[nodiscard]]
+    civ::ID* begin() const
+    {
+        return data;
+    }
+
+    [[nodiscard]]
+    civ::ID* end() const
+    {
+        return data + count;
+    }
+
+    [[nodiscard]]
+    uint32_t size() const
+    {
+        return count;
+    }
+
+    [[nodiscard]]
+    bool truncated() const
+    {
+        return found > count;
+    }
+
+    civ::ID operator[](uint32_t i) const
+    {
+        return data[i];
+    }
+};
+
+
+// Queries on the objects using the grid of the last sub step. They only read the solver so any number
+// of them can run at the same time from any thread, but not during an update.
+// Objects are matched by their center, those outside of the grid or dropped by a full cell are not found.
+namespace query
+{
+
+// Calls callback(data_index) for the objects of the cells that may hold a center in [min, max]
+template<typename TSolver, typename TCallback>
+void forEachCandidate(const TSolver& solver, Vec2 min, Vec2 max, TCallback&& callback)
+{
+    const auto forEachInCells = [&](const auto& cells, float inv_cell_size, int32_t offset) {
+        // Objects moved since the grid was built, one more cell around covers it
+        const int32_t x_min = std::max(to<int32_t>(std::floor(min.x * inv_cell_size)) + offset - 1, 0);
+        const int32_t y_min = std::max(to<int32_t>(std::floor(min.y * inv_cell_size)) + offset - 1, 0);
+        const int32_t x_max = std::min(to<int32_t>(std::floor(max.x * inv_cell_size)) + offset + 1, cells.width  - 1);
+        const int32_t y_max = std::min(to<int32_t>(std::floor(max.y * inv_cell_size)) + offset + 1, cells.height - 1);
+        for (int32_t x{x_min}; x <= x_max; ++x) {
+            for (int32_t y{y_min}; y <= y_max; ++y) {
+                const auto& cell = cells.get(x, y);
+                for (uint32_t i{0}; i < cell.objects_count; ++i) {
+                    callback(cell.objects[i]);
+                }
+            }
+        }
+    };
+    if constexpr (IsMultiLevelGrid<typename TSolver::Broadphase>::value) {
+        // Levels have a border of one cell
+        for (const auto& level : solver.grid.levels) {
+            if (level.objects_count) {
+                forEachInCells(level.cells, level.inv_cell_size, 1);
+            }
+        }
+    } else {
+        forEachInCells(solver.grid, 1.0f, 0);
+    }
+}
+
+template<typename TSolver>
+IDSpan radius(const TSolver& solver, Vec2 center, float radius, civ::ID* out, uint32_t capacity)
+{
+    IDSpan result{out, 0, 0};
+    const float radius2 = radius * radius;
+    forEachCandidate(solver, center - Vec2{radius, radius}, center + Vec2{radius, radius}, [&](uint32_t index) {
+        if (MathVec2::length2(solver.objects.data[index].getPosition() - center) <= radius2) {
+            if (result.count < capacity) {
+                out[result.count++] = solver.objects.getID(index);
+            }
+            ++result.found;
+        }
+    });
+    return result;
+}
+
+template<typename TSolver>
+IDSpan box(const TSolver& solver, Vec2 min, Vec2 max, civ::ID* out, uint32_t capacity)
+{
+    IDSpan result{out, 0, 0};
+    forEachCandidate(solver, min, max, [&](uint32_t index) {
+        const Vec2 p = solver.objects.data[index].getPosition();
+        if (p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y) {
+            if (result.count < capacity) {
+                out[result.count++] = solver.objects.getID(index);
+            }
+            ++result.found;
+        }
+    });
+    return result;
+}
+
+constexpr uint32_t max_neighbors = 64;
+
+// Up to k (at most max_neighbors) closest objects within max_radius, sorted by distance.
+// The search area grows until k objects are found closer than its half width
+template<typename TSolver>
+IDSpan nearest(const TSolver& solver, Vec2 center, uint32_t k, float max_radius, civ::ID* out)
+{
+    k = std::min(k, max_neighbors);
+    if (k == 0) {
+        return {out, 0, 0};
+    }
+    // No object is further than the farthest corner of the world, an unbounded radius (INFINITY or NaN)
+    // would otherwise keep doubling and overflow the cell coordinates
+    const Vec2  far_corner{std::max(center.x, solver.world_size.x - center.x), std::max(center.y, solver.world_size.y - center.y)};
+    const float world_radius = MathVec2::length(far_corner);
+    if (!(max_radius < world_radius)) {
+        max_radius = world_radius;
+    }
+    std::array<float,    max_neighbors> best_distances;
+    std::array<uint32_t, max_neighbors> best_indices;
+    uint32_t best_count{0};
+    float search_radius = std::min(2.0f, max_radius);
+    while (true) {
+        best_count = 0;
+        const float max_dist2 = search_radius * search_radius;
+        forEachCandidate(solver, center - Vec2{search_radius, search_radius}, center + Vec2{search_radius, search_radius}, [&](uint32_t index) {
+            const float dist2 = MathVec2::length2(solver.objects.data[index].getPosition() - center);
+            if (dist2 > max_dist2 || (best_count == k && dist2 >= best_distances[k - 1])) {
+                return;
+            }
+            // Insertion in the sorted list
+            uint32_t i = std::min(best_count, k - 1);
+            while (i > 0 && best_distances[i - 1] > dist2) {
+                best_distances[i] = best_distances[i - 1];
+                best_indices[i]   = best_indices[i - 1];
+                --i;
+            }
+            best_distances[i] = dist2;
+            best_indices[i]   = index;
+            best_count = std::min(best_count + 1, k);
+        });
+        if (best_count == k || search_radius >= max_radius) {
+            break;
+        }
+        search_radius = std::min(search_radius * 2.0f, max_radius);
+    }
+    for (uint32_t i{0}; i < best_count; ++i) {
+        out[i] = solver.objects.getID(best_indices[i]);
+    }
+    return {out, best_count, best_count};
+}
+
+// Radius queries in parallel on the thread pool, query i writes in out[i * capacity, (i + 1) * capacity)
+template<typename TSolver>
+void radiusBatch(const TSolver& solver, tp::ThreadPool& thread_pool, const Vec2* centers, uint32_t count, float query_radius,
+                 civ::ID* out, uint32_t capacity, IDSpan* results)
+{
+    thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+        for (uint32_t i{start}; i < end; ++i) {
+            results[i] = radius(solver, centers[i], query_radius, out + to<uint64_t>(i) * capacity, capacity);
+        }
+    });
+}
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <SFML/Graphics/Image.hpp>
+
+
+// Writes RGBA frames as an image sequence or pipes them to an encoder process
+class FrameWriter
+{
+public:
+    enum class Format
+    {
+        PPM,
+        PNG,
+        // Raw RGBA frames written to the standard input of a command, for instance
+        // ffmpeg -f rawvideo -pix_fmt rgba -s 1920x1080 -r 60 -i - output.mp4
+        Pipe,
+    };
+
+    FrameWriter() = default;
+
+    ~FrameWriter()
+    {
+        close();
+    }
+
+    // target is the output directory for image sequences and the encoder command for Pipe
+    bool open(Format format, const std::string& target, uint32_t width, uint32_t height)
+    {
+        close();
+        m_format = format;
+        m_target = target;
+        m_width  = width;
+        m_height = height;
+        m_frame  = 0;
+        if (format == Format::Pipe) {
+#ifdef _WIN32
+            m_pipe = _popen(target.c_str(), "wb");
+#else
+            // An encoder that exits must make write() fail instead of killing the process
+            std::signal(SIGPIPE, SIG_IGN);
+            m_pipe = popen(target.c_str(), "w");
+#endif
+            return m_pipe != nullptr;
+        }
+        std::error_code error;
+        std::filesystem::create_directories(target, error);
+        return !error;
+    }
+
+    bool write(const uint8_t* rgba)
+    {
+        bool success = false;
+        switch (m_format) {
+            case Format::PPM:
+                success = writePPM(rgba);
+                break;
+            case Format::PNG:
+                success = writePNG(rgba);
+                break;
+            case Format::Pipe:
+                success = m_pipe && std::fwrite(rgba, 4, m_width * m_height, m_pipe) == m_width * m_height;
+                break;
+        }
+        ++m_frame;
+        return success;
+    }
+
+    void close()
+    {
+        if (m_pipe) {
+#ifdef _WIN32
+            _pclose(m_pipe);
+#else
+            pclose(m_pipe);
+#endif
+            m_pipe = nullptr;
+        }
+    }
+
+private:
+    Format               m_format = Format::PPM;
+    std::string          m_target;
+    uint32_t             m_width  = 0;
+    uint32_t             m_height = 0;
+    uint32_t             m_frame  = 0;
+    std::FILE*           m_pipe   = nullptr;
+    std::vector<uint8_t> m_rgb;
+
+    [[nodiscard]]
+    std::string getFramePath(const char* extension) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06u.%s", m_frame, extension);
+        return (std::filesystem::path(m_target) / name).string();
+    }
+
+    bool writePPM(const uint8_t* rgba)
+    {
+        const uint32_t pixels_count = m_width * m_height;
+        m_rgb.resize(pixels_count * 3);
+        for (uint32_t i{0}; i < pixels_count; ++i) {
+            m_rgb[3 * i + 0] = rgba[4 * i + 0];
+            m_rgb[3 * i + 1] = rgba[4 * i + 1];
+            m_rgb[3 * i + 2] = rgba[4 * i + 2];
+        }
+        std::FILE* file = std::fopen(getFramePath("ppm").c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        std::fprintf(file, "P6\n%u %u\n255\n", m_width, m_height);
+        const bool written = std::fwrite(m_rgb.data(), 1, m_rgb.size(), file) == m_rgb.size();
+        // Buffered data is flushed by fclose, a full disk may only be reported there
+        const bool closed = std::fclose(file) == 0;
+        return written && closed;
+    }
+
+    bool writePNG(const uint8_t* rgba) const
+    {
+        sf::Image image;
+        image.create(m_width, m_height, rgba);
+        return image.saveToFile(getFramePath("png"));
+    }
+};
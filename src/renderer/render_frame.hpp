@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include "engine/common/arena.hpp"
+#include "engine/common/palette.hpp"
+#include "engine/common/utils.hpp"
+#include "physics/sized_object.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+struct RenderStats
+{
+    // Bytes written by the CPU into the particles vertices
+    uint64_t bytes_written    = 0;
+    // Bytes sent to the GPU
+    uint64_t bytes_uploaded   = 0;
+    uint64_t particles_drawn  = 0;
+    uint64_t particles_culled = 0;
+    // True when the density map was drawn instead of the particles
+    bool     density_map      = false;
+};
+
+
+// Part of the viewport the particles are prepared for
+struct RenderView
+{
+    float         zoom = 1.0f;
+    sf::FloatRect visible_rect;
+};
+
+
+// CPU side data of a frame, it only depends on the solver state when it was prepared
+// so it can be drawn later, from another thread, while the solver is already updated again
+struct RenderFrame
+{
+    enum class Mode
+    {
+        AllParticles,
+        VisibleParticles,
+        DensityMap,
+    };
+
+    Mode mode = Mode::AllParticles;
+
+    // Particles quads, texture coordinates and colors are only written once per particle,
+    // positions are streamed every frame
+    mem::Vector<sf::Vertex, mem::Tag::Renderer> objects_vertices;
+    uint64_t                                    static_attributes_count   = 0;
+    uint64_t                                    static_attributes_version = 0;
+    uint64_t                                    objects_layout_version    = 0;
+
+    // Used when only a small part of the world is visible, vertices of visible particles are written contiguously
+    mem::Vector<sf::Vertex, mem::Tag::Renderer> visible_vertices;
+    mem::Vector<uint32_t, mem::Tag::Renderer>   columns_offsets;
+
+    mem::Vector<uint8_t, mem::Tag::Renderer>    density_map_pixels;
+    sf::Vector2u                                density_map_size;
+
+    RenderStats stats;
+};
+
+
+// Writing of the particles quads, it only reads the solver so it does not need any graphics resource
+namespace render
+{
+
+constexpr float texture_size = 1024.0f;
+
+// Objects without their own size are drawn with a diameter of 1, like their cell
+template<typename TObject>
+float getObjectRadius(const TObject& object)
+{
+    if constexpr (std::is_same_v<TObject, SizedObject>) {
+        return object.radius;
+    } else {
+        return 0.5f;
+    }
+}
+
+inline void writeQuadPositions(sf::Vertex* vertices, Vec2 position, float radius)
+{
+    vertices[0].position = position + Vec2{-radius, -radius};
+    vertices[1].position = position + Vec2{ radius, -radius};
+    vertices[2].position = position + Vec2{ radius,  radius};
+    vertices[3].position = position + Vec2{-radius,  radius};
+}
+
+inline void writeQuadTexCoords(sf::Vertex* vertices)
+{
+    vertices[0].texCoords = {0.0f        , 0.0f};
+    vertices[1].texCoords = {texture_size, 0.0f};
+    vertices[2].texCoords = {texture_size, texture_size};
+    vertices[3].texCoords = {0.0f        , texture_size};
+}
+
+inline void writeQuadColor(sf::Vertex* vertices, sf::Color color)
+{
+    vertices[0].color = color;
+    vertices[1].color = color;
+    vertices[2].color = color;
+    vertices[3].color = color;
+}
+
+// Quads of all the objects in target.objects_vertices. Texture coordinates and colors are only written for the
+// objects created since the previous frame, or for all of them once the objects moved in memory or
+// static_attributes_version changed. With dynamic_colors the colors of all the objects are written every frame,
+// for colors changed by the simulation (kernels::ColorBySpeed)
+template<typename TSolver>
+void writeAllParticles(RenderFrame& target, const TSolver& solver, tp::ThreadPool& thread_pool, const Palette& palette,
+                       uint64_t static_attributes_version, bool dynamic_colors)
+{
+    const uint64_t objects_count = solver.objects.size();
+    auto& objects_vertices = target.objects_vertices;
+    objects_vertices.resize(objects_count * 4);
+    // Objects changed of index, their colors have to be written again
+    if (solver.objects.layout_version != target.objects_layout_version || static_attributes_version != target.static_attributes_version) {
+        target.objects_layout_version    = solver.objects.layout_version;
+        target.static_attributes_version = static_attributes_version;
+        target.static_attributes_count   = 0;
+    }
+    const uint64_t static_start = std::min(target.static_attributes_count, objects_count);
+    const uint64_t colors_start = dynamic_colors ? 0 : static_start;
+
+    thread_pool.dispatch(to<uint32_t>(objects_count), [&](uint32_t start, uint32_t end) {
+        for (uint32_t i{start}; i < end; ++i) {
+            const auto& object = solver.objects.data[i];
+            writeQuadPositions(&objects_vertices[i << 2], object.getPosition(), getObjectRadius(object));
+        }
+        // Static attributes of the objects created since the last frame
+        for (uint64_t i{std::max<uint64_t>(start, static_start)}; i < end; ++i) {
+            writeQuadTexCoords(&objects_vertices[i << 2]);
+        }
+        for (uint64_t i{std::max<uint64_t>(start, colors_start)}; i < end; ++i) {
+            writeQuadColor(&objects_vertices[i << 2], palette[solver.color_indices[i]]);
+        }
+    });
+    target.static_attributes_count = objects_count;
+
+    const uint64_t new_static_count = objects_count - static_start;
+    const uint64_t colors_count     = objects_count - colors_start;
+    target.mode                   = RenderFrame::Mode::AllParticles;
+    target.stats.bytes_written    = 4 * ((objects_count + new_static_count) * sizeof(sf::Vector2f) + colors_count * sizeof(sf::Color));
+    target.stats.bytes_uploaded   = 0;
+    target.stats.particles_drawn  = objects_count;
+    target.stats.particles_culled = 0;
+    target.stats.density_map      = false;
+}
+
+}
@@ -0,0 +1,209 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include "renderer.hpp"
+#include "engine/common/triple_buffer.hpp"
+
+
+struct PipelineStats
+{
+    uint64_t steps           = 0;
+    uint64_t frames_drawn    = 0;
+    // Frames prepared but replaced by a newer one before being drawn
+    uint64_t frames_dropped  = 0;
+    // Frames drawn again because no new one was ready
+    uint64_t frames_repeated = 0;
+    // Time between the start of the simulation step and the draw of its frame
+    float    last_latency_ms = 0.0f;
+    float    mean_latency_ms = 0.0f;
+    float    max_latency_ms  = 0.0f;
+};
+
+
+// Runs the simulation and the preparation of the frames on a dedicated thread while the thread
+// owning the window only draws the latest prepared frame. Uploading and presenting a frame
+// then overlaps with the simulation of the next one.
+template<typename TRenderer>
+class RenderPipeline
+{
+public:
+    using Clock        = std::chrono::steady_clock;
+    using StepCallback = std::function<void()>;
+
+    // steps_per_second limits the simulation rate, 0 runs it as fast as possible
+    RenderPipeline(TRenderer& renderer, StepCallback step, float steps_per_second)
+        : m_renderer{renderer}
+        , m_step{std::move(step)}
+        , m_steps_per_second{steps_per_second}
+    {}
+
+    ~RenderPipeline()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        if (m_running) {
+            return;
+        }
+        m_running = true;
+        m_thread  = std::thread([this]() {
+            run();
+        });
+    }
+
+    void stop()
+    {
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+        m_thread.join();
+    }
+
+    // Only one step out of frame_interval prepares a frame, the others only simulate
+    void setFrameInterval(uint32_t frame_interval)
+    {
+        m_frame_interval = std::max(frame_interval, 1u);
+    }
+
+    // The view is read by the simulation thread when preparing the next frame
+    void setView(const RenderView& view)
+    {
+        std::lock_guard<std::mutex> lock_guard{m_view_mutex};
+        m_view = view;
+    }
+
+    // The palette is read when preparing frames, it is replaced by the simulation thread before it prepares the next one.
+    // TRenderer::setPalette and invalidateStaticAttributes must not be called directly while the pipeline runs
+    void setPalette(Palette palette)
+    {
+        std::lock_guard<std::mutex> lock_guard{m_changes_mutex};
+        m_pending_palette     = std::move(palette);
+        m_has_pending_palette = true;
+    }
+
+    // Colors are written again for all the objects in the next prepared frame
+    void invalidateStaticAttributes()
+    {
+        std::lock_guard<std::mutex> lock_guard{m_changes_mutex};
+        m_pending_invalidation = true;
+    }
+
+    // Draws the latest prepared frame, has to be called from the thread owning the window
+    void draw(RenderContext& context)
+    {
+        bool is_new = false;
+        TimedFrame* frame = m_frames.getLatest(is_new);
+        if (!frame) {
+            return;
+        }
+        m_renderer.draw(context, frame->frame);
+
+        ++m_frames_drawn;
+        m_frames_repeated += !is_new;
+        if (is_new) {
+            const float latency_ms = std::chrono::duration<float, std::milli>(Clock::now() - frame->step_start).count();
+            m_last_latency_ms   = latency_ms;
+            m_max_latency_ms    = std::max(m_max_latency_ms, latency_ms);
+            m_latency_sum_ms   += latency_ms;
+            ++m_latency_count;
+        }
+    }
+
+    [[nodiscard]]
+    PipelineStats getStats() const
+    {
+        PipelineStats stats;
+        stats.steps           = m_steps;
+        stats.frames_drawn    = m_frames_drawn;
+        stats.frames_dropped  = m_frames.getDroppedCount();
+        stats.frames_repeated = m_frames_repeated;
+        stats.last_latency_ms = m_last_latency_ms;
+        stats.mean_latency_ms = m_latency_count ? static_cast<float>(m_latency_sum_ms / static_cast<double>(m_latency_count)) : 0.0f;
+        stats.max_latency_ms  = m_max_latency_ms;
+        return stats;
+    }
+
+private:
+    struct TimedFrame
+    {
+        RenderFrame       frame;
+        Clock::time_point step_start;
+    };
+
+    TRenderer&                m_renderer;
+    StepCallback              m_step;
+    float                     m_steps_per_second;
+    std::atomic<uint32_t>     m_frame_interval = 1;
+
+    std::thread               m_thread;
+    std::atomic<bool>         m_running = false;
+    std::atomic<uint64_t>     m_steps   = 0;
+
+    TripleBuffer<TimedFrame>  m_frames;
+    std::mutex                m_view_mutex;
+    RenderView                m_view;
+
+    // Renderer changes waiting for the simulation thread
+    std::mutex                m_changes_mutex;
+    Palette                   m_pending_palette;
+    bool                      m_has_pending_palette  = false;
+    bool                      m_pending_invalidation = false;
+
+    // Only accessed by the drawing thread
+    uint64_t                  m_frames_drawn    = 0;
+    uint64_t                  m_frames_repeated = 0;
+    float                     m_last_latency_ms = 0.0f;
+    float                     m_max_latency_ms  = 0.0f;
+    double                    m_latency_sum_ms  = 0.0;
+    uint64_t                  m_latency_count   = 0;
+
+    // Called by the simulation thread, the only one preparing frames
+    void applyPendingChanges()
+    {
+        std::lock_guard<std::mutex> lock_guard{m_changes_mutex};
+        if (m_has_pending_palette) {
+            // Also invalidates the static attributes
+            m_renderer.setPalette(std::move(m_pending_palette));
+            m_has_pending_palette = false;
+        } else if (m_pending_invalidation) {
+            m_renderer.invalidateStaticAttributes();
+        }
+        m_pending_invalidation = false;
+    }
+
+    void run()
+    {
+        const bool limit_rate = m_steps_per_second > 0.0f;
+        const auto step_duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(limit_rate ? 1.0f / m_steps_per_second : 0.0f));
+        Clock::time_point next_step = Clock::now();
+        while (m_running) {
+            if (limit_rate) {
+                std::this_thread::sleep_until(next_step);
+                // Do not try to catch up if the simulation is too slow
+                next_step = std::max(next_step + step_duration, Clock::now());
+            }
+
+            const Clock::time_point step_start = Clock::now();
+            m_step();
+            if (++m_steps % m_frame_interval) {
+                continue;
+            }
+            TimedFrame& target = m_frames.getWriteBuffer();
+            target.step_start  = step_start;
+            RenderView view;
+            {
+                std::lock_guard<std::mutex> lock_guard{m_view_mutex};
+                view = m_view;
+            }
+            applyPendingChanges();
+            m_renderer.prepare(target.frame, view);
+            m_frames.publish();
+        }
+    }
+};
@@ -1,10 +1,12 @@
 #include "renderer.hpp"
 
 
-Renderer::Renderer(PhysicSolver& solver_, tp::ThreadPool& tp)
+template<typename TSolver>
+BasicRenderer<TSolver>::BasicRenderer(TSolver& solver_, tp::ThreadPool& tp)
     : solver{solver_}
     , world_va{sf::Quads, 4}
-    , objects_va{sf::Quads}
+    , objects_vb{sf::Quads, sf::VertexBuffer::Stream}
+    , density_map_va{sf::Quads, 4}
     , thread_pool{tp}
 {
     initializeWorldVA();
@@ -14,7 +16,31 @@ Renderer::Renderer(PhysicSolver& solver_, tp::ThreadPool& tp)
     object_texture.setSmooth(true);
 }
 
-void Renderer::render(RenderContext& context)
+template<typename TSolver>
+void BasicRenderer<TSolver>::render(RenderContext& context)
+{
+    prepare(frame, getView(context));
+    draw(context, frame);
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::prepare(RenderFrame& target, const RenderView& view)
+{
+    if constexpr (uses_collision_grid) {
+        if (view.zoom < density_map_max_pixels && !solver.grid.data.empty()) {
+            updateDensityMap(target);
+            return;
+        }
+    }
+    if (isCullingUseful(view.visible_rect)) {
+        updateVisibleParticlesVA(target, view.visible_rect);
+    } else {
+        updateParticlesVA(target);
+    }
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::draw(RenderContext& context, RenderFrame& source)
 {
     context.draw(world_va);
 
@@ -22,11 +48,35 @@ void Renderer::render(RenderContext& context)
     states.texture = &object_texture;
     context.draw(world_va, states);
     // Particles
-    updateParticlesVA();
-    context.draw(objects_va, states);
+    if (source.mode == RenderFrame::Mode::DensityMap) {
+        uploadDensityMap(source);
+        sf::RenderStates density_states;
+        density_states.texture = &density_map_texture;
+        context.draw(density_map_va, density_states);
+        source.stats.bytes_uploaded = source.density_map_pixels.size();
+    } else {
+        const auto& vertices = source.mode == RenderFrame::Mode::VisibleParticles ? source.visible_vertices : source.objects_vertices;
+        const uint64_t vertex_count = source.stats.particles_drawn * 4;
+        if (sf::VertexBuffer::isAvailable()) {
+            uploadParticlesVertices(vertices, vertex_count);
+            context.draw(objects_vb, 0, vertex_count, states);
+            source.stats.bytes_uploaded = vertex_count * sizeof(sf::Vertex);
+        } else {
+            context.draw(vertices.data(), vertex_count, sf::Quads, states);
+            source.stats.bytes_uploaded = 0;
+        }
+    }
+    stats = source.stats;
+}
+
+template<typename TSolver>
+RenderView BasicRenderer<TSolver>::getView(const RenderContext& context)
+{
+    return {context.getZoom(), context.getVisibleRect()};
 }
 
-void Renderer::initializeWorldVA()
+template<typename TSolver>
+void BasicRenderer<TSolver>::initializeWorldVA()
 {
     world_va[0].position = {0.0f               , 0.0f};
     world_va[1].position = {solver.world_size.x, 0.0f};
@@ -41,30 +91,201 @@ void Renderer::initializeWorldVA()
     world_va[3].color = background_color;
 }
 
-void Renderer::updateParticlesVA()
+template<typename TSolver>
+void BasicRenderer<TSolver>::updateParticlesVA(RenderFrame& target)
 {
-    objects_va.resize(solver.objects.size() * 4);
-
-    const float texture_size = 1024.0f;
-    const float radius       = 0.5f;
-    thread_pool.dispatch(to<uint32_t>(solver.objects.size()), [&](uint32_t start, uint32_t end) {
-        for (uint32_t i{start}; i < end; ++i) {
-            const PhysicObject& object = solver.objects.data[i];
-            const uint32_t idx = i << 2;
-            objects_va[idx + 0].position = object.position + Vec2{-radius, -radius};
-            objects_va[idx + 1].position = object.position + Vec2{ radius, -radius};
-            objects_va[idx + 2].position = object.position + Vec2{ radius,  radius};
-            objects_va[idx + 3].position = object.position + Vec2{-radius,  radius};
-            objects_va[idx + 0].texCoords = {0.0f        , 0.0f};
-            objects_va[idx + 1].texCoords = {texture_size, 0.0f};
-            objects_va[idx + 2].texCoords = {texture_size, texture_size};
-            objects_va[idx + 3].texCoords = {0.0f        , texture_size};
-
-            const sf::Color color = object.color;
-            objects_va[idx + 0].color = color;
-            objects_va[idx + 1].color = color;
-            objects_va[idx + 2].color = color;
-            objects_va[idx + 3].color = color;
+    render::writeAllParticles(target, solver, thread_pool, palette, static_attributes_version, dynamic_colors);
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::updateDensityMap(RenderFrame& target)
+{
+    if constexpr (uses_collision_grid) {
+        const auto& grid = solver.grid;
+        const auto width  = to<uint32_t>(grid.width);
+        const auto height = to<uint32_t>(grid.height);
+        target.density_map_size = {width, height};
+        target.density_map_pixels.resize(width * height * 4);
+
+        thread_pool.dispatch(width, [&](uint32_t start, uint32_t end) {
+            for (uint32_t x{start}; x < end; ++x) {
+                for (uint32_t y{0}; y < height; ++y) {
+                    const auto& cell = grid.get(to<int32_t>(x), to<int32_t>(y));
+                    uint32_t r = 0;
+                    uint32_t g = 0;
+                    uint32_t b = 0;
+                    for (uint32_t k{0}; k < cell.objects_count; ++k) {
+                        const sf::Color color = palette[solver.color_indices[cell.objects[k]]];
+                        r += color.r;
+                        g += color.g;
+                        b += color.b;
+                    }
+                    uint8_t* pixel = &target.density_map_pixels[(y * width + x) * 4];
+                    const uint32_t count = std::max(cell.objects_count, 1u);
+                    pixel[0] = to<uint8_t>(r / count);
+                    pixel[1] = to<uint8_t>(g / count);
+                    pixel[2] = to<uint8_t>(b / count);
+                    // A single particle almost covers its cell
+                    pixel[3] = to<uint8_t>(std::min(cell.objects_count * 255u, 255u));
+                }
+            }
+        });
+
+        target.mode                   = RenderFrame::Mode::DensityMap;
+        target.stats.bytes_written    = target.density_map_pixels.size();
+        target.stats.bytes_uploaded   = 0;
+        target.stats.particles_drawn  = 0;
+        target.stats.particles_culled = 0;
+        target.stats.density_map      = true;
+    } else {
+        updateParticlesVA(target);
+    }
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::uploadDensityMap(const RenderFrame& source)
+{
+    if (density_map_texture.getSize() != source.density_map_size) {
+        density_map_texture.create(source.density_map_size.x, source.density_map_size.y);
+        density_map_texture.setSmooth(true);
+
+        const Vec2 texture_size = toVector2f(source.density_map_size);
+        density_map_va[0].position  = {0.0f               , 0.0f};
+        density_map_va[1].position  = {solver.world_size.x, 0.0f};
+        density_map_va[2].position  = {solver.world_size.x, solver.world_size.y};
+        density_map_va[3].position  = {0.0f               , solver.world_size.y};
+        density_map_va[0].texCoords = {0.0f          , 0.0f};
+        density_map_va[1].texCoords = {texture_size.x, 0.0f};
+        density_map_va[2].texCoords = {texture_size.x, texture_size.y};
+        density_map_va[3].texCoords = {0.0f          , texture_size.y};
+    }
+    density_map_texture.update(source.density_map_pixels.data());
+}
+
+template<typename TSolver>
+bool BasicRenderer<TSolver>::isCullingUseful(sf::FloatRect visible_rect) const
+{
+    if constexpr (!uses_collision_grid) {
+        return false;
+    } else {
+        // The grid is filled by the solver's update, it is empty before the first one
+        if (solver.objects.size() == 0 || solver.grid.data.empty()) {
+            return false;
+        }
+        const float visible_width  = std::min(visible_rect.left + visible_rect.width , solver.world_size.x) - std::max(visible_rect.left, 0.0f);
+        const float visible_height = std::min(visible_rect.top  + visible_rect.height, solver.world_size.y) - std::max(visible_rect.top , 0.0f);
+        const float visible_area   = std::max(visible_width, 0.0f) * std::max(visible_height, 0.0f);
+        return visible_area < culling_max_visible_ratio * solver.world_size.x * solver.world_size.y;
+    }
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::updateVisibleParticlesVA(RenderFrame& target, sf::FloatRect visible_rect)
+{
+    if constexpr (uses_collision_grid) {
+        const auto& grid = solver.grid;
+        // Objects moved a bit since they were added to the grid and they overlap neighbor cells
+        const int32_t margin = 2;
+        const int32_t x_min  = std::max(static_cast<int32_t>(visible_rect.left) - margin, 0);
+        const int32_t y_min  = std::max(static_cast<int32_t>(visible_rect.top)  - margin, 0);
+        const int32_t x_max  = std::min(static_cast<int32_t>(visible_rect.left + visible_rect.width)  + margin, grid.width  - 1);
+        const int32_t y_max  = std::min(static_cast<int32_t>(visible_rect.top  + visible_rect.height) + margin, grid.height - 1);
+        // The view can be out of the grid, only the dropped objects can be visible then
+        const uint32_t columns_count = (x_max < x_min || y_max < y_min) ? 0 : to<uint32_t>(x_max - x_min + 1);
+
+        // Count visible objects per column to know where each column writes its vertices
+        auto& columns_offsets = target.columns_offsets;
+        columns_offsets.resize(columns_count + 1);
+        columns_offsets[0] = 0;
+        thread_pool.dispatch(columns_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                const int32_t x = x_min + to<int32_t>(i);
+                uint32_t count = 0;
+                for (int32_t y{y_min}; y <= y_max; ++y) {
+                    count += grid.get(x, y).objects_count;
+                }
+                columns_offsets[i + 1] = count;
+            }
+        });
+        for (uint32_t i{0}; i < columns_count; ++i) {
+            columns_offsets[i + 1] += columns_offsets[i];
         }
-    });
+        const uint32_t grid_visible_count = columns_offsets[columns_count];
+        const auto     max_visible_count  = grid_visible_count + to<uint32_t>(solver.dropped_objects.size());
+        if (target.visible_vertices.size() < max_visible_count * 4) {
+            target.visible_vertices.resize(max_visible_count * 4);
+        }
+
+        // Objects stored in a collision grid all have the size of its cells
+        const float radius = 0.5f;
+        const auto writeObject = [&](sf::Vertex* vertices, uint32_t index) {
+            render::writeQuadPositions(vertices, solver.objects.data[index].getPosition(), radius);
+            render::writeQuadTexCoords(vertices);
+            render::writeQuadColor(vertices, palette[solver.color_indices[index]]);
+        };
+        thread_pool.dispatch(columns_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                const int32_t x = x_min + to<int32_t>(i);
+                sf::Vertex* vertices = &target.visible_vertices[columns_offsets[i] * 4];
+                for (int32_t y{y_min}; y <= y_max; ++y) {
+                    const auto& cell = grid.get(x, y);
+                    for (uint32_t k{0}; k < cell.objects_count; ++k) {
+                        writeObject(vertices, cell.objects[k]);
+                        vertices += 4;
+                    }
+                }
+            }
+        });
+
+        // Objects the grid dropped are in none of its cells, they are tested one by one after the columns
+        uint32_t visible_count = grid_visible_count;
+        for (const uint32_t index : solver.dropped_objects) {
+            const Vec2 position = solver.objects.data[index].getPosition();
+            if (position.x > visible_rect.left - radius && position.x < visible_rect.left + visible_rect.width  + radius &&
+                position.y > visible_rect.top  - radius && position.y < visible_rect.top  + visible_rect.height + radius) {
+                writeObject(&target.visible_vertices[visible_count * 4], index);
+                ++visible_count;
+            }
+        }
+
+        const uint64_t objects_count = solver.objects.size();
+        target.mode                   = RenderFrame::Mode::VisibleParticles;
+        target.stats.bytes_written    = visible_count * 4 * sizeof(sf::Vertex);
+        target.stats.bytes_uploaded   = 0;
+        target.stats.particles_drawn  = visible_count;
+        target.stats.particles_culled = objects_count - std::min<uint64_t>(visible_count, objects_count);
+        target.stats.density_map      = false;
+    } else {
+        updateParticlesVA(target);
+    }
 }
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::uploadParticlesVertices(const mem::Vector<sf::Vertex, mem::Tag::Renderer>& vertices, uint64_t vertex_count)
+{
+    if (vertex_count > objects_vb_capacity) {
+        // Grow with some margin to avoid recreating the buffer while objects are being spawned
+        objects_vb_capacity = std::max(vertex_count, objects_vb_capacity + objects_vb_capacity / 2);
+        objects_vb.create(objects_vb_capacity);
+    }
+    if (vertex_count) {
+        objects_vb.update(vertices.data(), vertex_count, 0);
+    }
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::invalidateStaticAttributes()
+{
+    ++static_attributes_version;
+}
+
+template<typename TSolver>
+void BasicRenderer<TSolver>::setPalette(Palette new_palette)
+{
+    palette = std::move(new_palette);
+    invalidateStaticAttributes();
+}
+
+template struct BasicRenderer<PhysicSolver>;
+template struct BasicRenderer<QuantizedPhysicSolver>;
+template struct BasicRenderer<PolydisperseSolver>;
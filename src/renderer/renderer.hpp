@@ -1,27 +1,85 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 #include "physics/physics.hpp"
+#include "render_frame.hpp"
 #include "engine/window_context_handler.hpp"
 
 
-struct Renderer
+// Draws the objects of any solver. The density map and the culling read the cells of the collision grid,
+// the solvers using a multi-level grid always draw all their objects
+template<typename TSolver>
+struct BasicRenderer
 {
-    PhysicSolver& solver;
+    static constexpr bool uses_collision_grid = !IsMultiLevelGrid<typename TSolver::Broadphase>::value;
+
+    TSolver& solver;
 
     sf::VertexArray world_va;
-    sf::VertexArray objects_va;
     sf::Texture     object_texture;
+    // Objects colors are expanded from their palette index when writing vertices
+    Palette         palette = Palette::createRainbow();
+
+    sf::VertexBuffer objects_vb;
+    uint64_t         objects_vb_capacity = 0;
+    // Incremented to force texture coordinates and colors to be written again
+    uint64_t         static_attributes_version = 1;
+    // Colors are written every frame instead of once per particle, needed when the simulation changes them
+    std::atomic<bool> dynamic_colors = false;
+
+    // Culling is only used when the visible area is smaller than this ratio of the world
+    float            culling_max_visible_ratio = 0.5f;
+
+    // Level of detail: below this size on screen, particles are replaced by a density map of the grid
+    float            density_map_max_pixels = 3.0f;
+    sf::VertexArray  density_map_va;
+    sf::Texture      density_map_texture;
+
+    // Frame used when preparing and drawing are done in the same thread
+    RenderFrame frame;
+    // Stats of the last drawn frame
+    RenderStats stats;
 
     tp::ThreadPool& thread_pool;
 
     explicit
-    Renderer(PhysicSolver& solver_, tp::ThreadPool& tp);
+    BasicRenderer(TSolver& solver_, tp::ThreadPool& tp);
 
+    // Prepares and draws the current state of the solver
     void render(RenderContext& context);
 
+    // Reads the solver, uses the thread pool but no graphics resource
+    void prepare(RenderFrame& target, const RenderView& view);
+
+    // Uploads and draws a prepared frame, has to be called from the thread owning the window
+    void draw(RenderContext& context, RenderFrame& source);
+
+    [[nodiscard]]
+    static RenderView getView(const RenderContext& context);
+
     void initializeWorldVA();
 
-    void updateParticlesVA();
+    void updateParticlesVA(RenderFrame& target);
+
+    // Only emits particles in visible cells, using the collision grid as spatial index, and the visible objects it dropped
+    void updateVisibleParticlesVA(RenderFrame& target, sf::FloatRect visible_rect);
+
+    [[nodiscard]]
+    bool isCullingUseful(sf::FloatRect visible_rect) const;
+
+    // Writes one pixel per grid cell with the mean color of its objects, alpha encodes the cell occupancy
+    void updateDensityMap(RenderFrame& target);
+
+    void uploadDensityMap(const RenderFrame& source);
+
+    void uploadParticlesVertices(const mem::Vector<sf::Vertex, mem::Tag::Renderer>& vertices, uint64_t vertex_count);
+
+    // Forces texture coordinates and colors to be written again, needed if objects colors are modified.
+    // Not synchronized with prepare, use the RenderPipeline functions when frames are prepared on another thread
+    void invalidateStaticAttributes();
+
+    void setPalette(Palette new_palette);
 
     void renderHUD(RenderContext& context);
 };
+
+using Renderer = BasicRenderer<PhysicSolver>;
@@ -0,0 +1,179 @@
+#include "software_renderer.hpp"
+#include "render_frame.hpp"
+#include <cmath>
+
+
+template<typename TSolver>
+BasicSoftwareRenderer<TSolver>::BasicSoftwareRenderer(TSolver& solver_, tp::ThreadPool& tp, uint32_t width_, uint32_t height_)
+    : solver{solver_}
+    , thread_pool{tp}
+    , width{width_}
+    , height{height_}
+    , pixels(width_ * height_ * 4, 255)
+    , tiles_x{(width_  + tile_size - 1) / tile_size}
+    , tiles_y{(height_ + tile_size - 1) / tile_size}
+{
+    fitWorld(10.0f);
+}
+
+template<typename TSolver>
+void BasicSoftwareRenderer<TSolver>::fitWorld(float margin)
+{
+    const float zoom_x = (to<float>(width)  - 2.0f * margin) / solver.world_size.x;
+    const float zoom_y = (to<float>(height) - 2.0f * margin) / solver.world_size.y;
+    zoom   = std::max(std::min(zoom_x, zoom_y), 0.01f);
+    offset = solver.world_size * 0.5f - Vec2{to<float>(width), to<float>(height)} * (0.5f / zoom);
+}
+
+template<typename TSolver>
+void BasicSoftwareRenderer<TSolver>::render()
+{
+    binObjects();
+    thread_pool.dispatch(tiles_x * tiles_y, [&](uint32_t start, uint32_t end) {
+        for (uint32_t i{start}; i < end; ++i) {
+            renderTile(i % tiles_x, i / tiles_x);
+        }
+    });
+}
+
+template<typename TSolver>
+const uint8_t* BasicSoftwareRenderer<TSolver>::getPixels() const
+{
+    return pixels.data();
+}
+
+template<typename TSolver>
+template<typename TCallback>
+void BasicSoftwareRenderer<TSolver>::forEachObjectTile(uint32_t index, TCallback&& callback) const
+{
+    // Same pixels as drawDisc
+    const auto& object      = solver.objects.data[index];
+    const Vec2  center      = (object.getPosition() - offset) * zoom;
+    const float disc_radius = render::getObjectRadius(object) * zoom;
+    const float x_min = std::floor(center.x - disc_radius);
+    const float y_min = std::floor(center.y - disc_radius);
+    const float x_max = std::ceil(center.x + disc_radius);
+    const float y_max = std::ceil(center.y + disc_radius);
+    // Also skips the objects with a non finite position
+    if (!(x_max > 0.0f && y_max > 0.0f && x_min < to<float>(width) && y_min < to<float>(height))) {
+        return;
+    }
+    const uint32_t tile_x_min = to<uint32_t>(std::max(x_min, 0.0f)) / tile_size;
+    const uint32_t tile_y_min = to<uint32_t>(std::max(y_min, 0.0f)) / tile_size;
+    const uint32_t tile_x_max = std::min(to<uint32_t>(x_max - 1.0f) / tile_size, tiles_x - 1);
+    const uint32_t tile_y_max = std::min(to<uint32_t>(y_max - 1.0f) / tile_size, tiles_y - 1);
+    for (uint32_t tile_y{tile_y_min}; tile_y <= tile_y_max; ++tile_y) {
+        for (uint32_t tile_x{tile_x_min}; tile_x <= tile_x_max; ++tile_x) {
+            callback(tile_y * tiles_x + tile_x);
+        }
+    }
+}
+
+template<typename TSolver>
+void BasicSoftwareRenderer<TSolver>::binObjects()
+{
+    const uint32_t tiles_count   = tiles_x * tiles_y;
+    const uint32_t batch_count   = thread_pool.m_thread_count;
+    const auto     objects_count = to<uint32_t>(solver.objects.size());
+    const uint32_t batch_size    = objects_count / batch_count + 1;
+    batch_counts.assign(batch_count * tiles_count, 0);
+    thread_pool.dispatch(batch_count, [&](uint32_t start, uint32_t end) {
+        for (uint32_t batch{start}; batch < end; ++batch) {
+            uint32_t* counts = &batch_counts[batch * tiles_count];
+            const uint32_t last = std::min((batch + 1) * batch_size, objects_count);
+            for (uint32_t i{batch * batch_size}; i < last; ++i) {
+                forEachObjectTile(i, [&](uint32_t tile) { ++counts[tile]; });
+            }
+        }
+    });
+
+    // Tiles are contiguous, and in each tile the batches are in order so the objects are drawn in index order
+    tile_offsets.resize(tiles_count + 1);
+    uint32_t total = 0;
+    for (uint32_t tile{0}; tile < tiles_count; ++tile) {
+        tile_offsets[tile] = total;
+        for (uint32_t batch{0}; batch < batch_count; ++batch) {
+            const uint32_t count = batch_counts[batch * tiles_count + tile];
+            batch_counts[batch * tiles_count + tile] = total;
+            total += count;
+        }
+    }
+    tile_offsets[tiles_count] = total;
+    tile_objects.resize(total);
+
+    thread_pool.dispatch(batch_count, [&](uint32_t start, uint32_t end) {
+        for (uint32_t batch{start}; batch < end; ++batch) {
+            uint32_t* positions = &batch_counts[batch * tiles_count];
+            const uint32_t last = std::min((batch + 1) * batch_size, objects_count);
+            for (uint32_t i{batch * batch_size}; i < last; ++i) {
+                forEachObjectTile(i, [&](uint32_t tile) { tile_objects[positions[tile]++] = i; });
+            }
+        }
+    });
+}
+
+template<typename TSolver>
+void BasicSoftwareRenderer<TSolver>::renderTile(uint32_t tile_x, uint32_t tile_y)
+{
+    const int32_t x_min = to<int32_t>(tile_x * tile_size);
+    const int32_t y_min = to<int32_t>(tile_y * tile_size);
+    const int32_t x_max = std::min(x_min + to<int32_t>(tile_size), to<int32_t>(width));
+    const int32_t y_max = std::min(y_min + to<int32_t>(tile_size), to<int32_t>(height));
+
+    // Background
+    const Vec2 world_pixel_min = -offset * zoom;
+    const Vec2 world_pixel_max = (solver.world_size - offset) * zoom;
+    for (int32_t y{y_min}; y < y_max; ++y) {
+        uint8_t* pixel = &pixels[(y * width + x_min) * 4];
+        for (int32_t x{x_min}; x < x_max; ++x) {
+            const float px = to<float>(x) + 0.5f;
+            const float py = to<float>(y) + 0.5f;
+            const bool inside = px >= world_pixel_min.x && px < world_pixel_max.x && py >= world_pixel_min.y && py < world_pixel_max.y;
+            const sf::Color color = inside ? background_color : outside_color;
+            pixel[0] = color.r;
+            pixel[1] = color.g;
+            pixel[2] = color.b;
+            pixel[3] = 255;
+            pixel += 4;
+        }
+    }
+
+    const uint32_t tile = tile_y * tiles_x + tile_x;
+    for (uint32_t k{tile_offsets[tile]}; k < tile_offsets[tile + 1]; ++k) {
+        const uint32_t index  = tile_objects[k];
+        const auto&    object = solver.objects.data[index];
+        const Vec2     center = (object.getPosition() - offset) * zoom;
+        drawDisc(center, render::getObjectRadius(object) * zoom, palette[solver.color_indices[index]], x_min, y_min, x_max, y_max);
+    }
+}
+
+template<typename TSolver>
+void BasicSoftwareRenderer<TSolver>::drawDisc(Vec2 center, float disc_radius, sf::Color color, int32_t x_min, int32_t y_min, int32_t x_max, int32_t y_max)
+{
+    const int32_t start_x = std::max(static_cast<int32_t>(std::floor(center.x - disc_radius)), x_min);
+    const int32_t start_y = std::max(static_cast<int32_t>(std::floor(center.y - disc_radius)), y_min);
+    const int32_t end_x   = std::min(static_cast<int32_t>(std::ceil(center.x + disc_radius)), x_max);
+    const int32_t end_y   = std::min(static_cast<int32_t>(std::ceil(center.y + disc_radius)), y_max);
+    // Discs smaller than a pixel only partially cover it
+    const float size_factor = std::min(2.0f * disc_radius, 1.0f);
+    const float max_alpha   = 255.0f * size_factor * size_factor;
+    for (int32_t y{start_y}; y < end_y; ++y) {
+        const float dy = to<float>(y) + 0.5f - center.y;
+        uint8_t* pixel = &pixels[(y * width + start_x) * 4];
+        for (int32_t x{start_x}; x < end_x; ++x) {
+            const float dx = to<float>(x) + 0.5f - center.x;
+            // One pixel wide smooth edge, like the circle texture
+            const float coverage = std::min(std::max(disc_radius - std::sqrt(dx * dx + dy * dy) + 0.5f, 0.0f), 1.0f);
+            const auto  alpha    = static_cast<uint32_t>(coverage * max_alpha);
+            const uint32_t inv_alpha = 255 - alpha;
+            pixel[0] = to<uint8_t>((pixel[0] * inv_alpha + color.r * alpha) / 255);
+            pixel[1] = to<uint8_t>((pixel[1] * inv_alpha + color.g * alpha) / 255);
+            pixel[2] = to<uint8_t>((pixel[2] * inv_alpha + color.b * alpha) / 255);
+            pixel += 4;
+        }
+    }
+}
+
+template struct BasicSoftwareRenderer<PhysicSolver>;
+template struct BasicSoftwareRenderer<QuantizedPhysicSolver>;
+template struct BasicSoftwareRenderer<PolydisperseSolver>;
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <SFML/Graphics/Color.hpp>
+#include "physics/physics.hpp"
+
+
+// Rasterizes the particles on the CPU, without window nor OpenGL context.
+// The objects are first binned in the tiles of the framebuffer they overlap, then the tiles are rendered in parallel.
+// Binning from the objects rather than the collision grid also draws the objects the grid dropped.
+template<typename TSolver>
+struct BasicSoftwareRenderer
+{
+    static constexpr uint32_t tile_size = 64;
+
+    TSolver&        solver;
+    tp::ThreadPool& thread_pool;
+
+    uint32_t width;
+    uint32_t height;
+    // RGBA, row by row
+    mem::Vector<uint8_t, mem::Tag::Renderer> pixels;
+
+    // pixel = (world_position - offset) * zoom, objects have the same radius as with the GPU renderer
+    float zoom   = 1.0f;
+    Vec2  offset = {0.0f, 0.0f};
+
+    Palette   palette = Palette::createRainbow();
+    sf::Color background_color{50, 50, 50};
+    sf::Color outside_color{0, 0, 0};
+
+    BasicSoftwareRenderer(TSolver& solver_, tp::ThreadPool& tp, uint32_t width_, uint32_t height_);
+
+    // Centers the world in the framebuffer with margin pixels around it
+    void fitWorld(float margin);
+
+    void render();
+
+    [[nodiscard]]
+    const uint8_t* getPixels() const;
+
+private:
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    // Objects of each tile in index order, tile i draws tile_objects[tile_offsets[i]] to tile_objects[tile_offsets[i + 1]]
+    mem::Vector<uint32_t, mem::Tag::Renderer> tile_objects;
+    mem::Vector<uint32_t, mem::Tag::Renderer> tile_offsets;
+    // Objects count of each tile per batch, then the position where the batch writes its next object
+    mem::Vector<uint32_t, mem::Tag::Renderer> batch_counts;
+
+    void binObjects();
+
+    template<typename TCallback>
+    void forEachObjectTile(uint32_t index, TCallback&& callback) const;
+
+    void renderTile(uint32_t tile_x, uint32_t tile_y);
+
+    // Anti-aliased disc clipped to the [x_min, x_max) x [y_min, y_max) pixels
+    void drawDisc(Vec2 center, float disc_radius, sf::Color color, int32_t x_min, int32_t y_min, int32_t x_max, int32_t y_max);
+};
+
+using SoftwareRenderer = BasicSoftwareRenderer<PhysicSolver>;
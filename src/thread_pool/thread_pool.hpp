@@ -10,11 +10,20 @@
 namespace tp
 {
 
+// Notified by the workers around each task they run, used to measure the work of each thread
+struct TaskObserver
+{
+    virtual ~TaskObserver() = default;
+    virtual void onTaskStart(uint32_t worker_id) = 0;
+    virtual void onTaskEnd(uint32_t worker_id) = 0;
+};
+
 struct TaskQueue
 {
     std::queue<std::function<void()>> m_tasks;
     std::mutex                        m_mutex;
     std::atomic<uint32_t>             m_remaining_tasks = 0;
+    std::atomic<TaskObserver*>        m_observer        = nullptr;
 
     template<typename TCallback>
     void addTask(TCallback&& callback)
@@ -80,7 +89,14 @@ struct Worker
             if (m_task == nullptr) {
                 TaskQueue::wait();
             } else {
+                TaskObserver* observer = m_queue->m_observer.load(std::memory_order_acquire);
+                if (observer) {
+                    observer->onTaskStart(m_id);
+                }
                 m_task();
+                if (observer) {
+                    observer->onTaskEnd(m_id);
+                }
                 m_queue->workDone();
                 m_task = nullptr;
             }
@@ -128,6 +144,12 @@ struct ThreadPool
         m_queue.waitForCompletion();
     }
 
+    // Has to be set while no task is running, nullptr removes it
+    void setTaskObserver(TaskObserver* observer)
+    {
+        m_queue.m_observer.store(observer, std::memory_order_release);
+    }
+
     template<typename TCallback>
     void dispatch(uint32_t element_count, TCallback&& callback)
     {